@@ -0,0 +1,74 @@
+#include<stdint.h>
+#include<stddef.h>
+#include<math.h>
+
+#include "dsp.h"
+
+// per channel automatic gain control
+//  tracks the mean square of each analysis window with a one pole filter that
+//  follows rises with the attack time and falls with the release time,
+//  the filter is stepped once per hop, so its cost doesn't depend on the history length
+
+#define AGC_LANES 8
+// keeps silence from being blown up into noise
+#define AGC_MAX_GAIN 100.0f
+
+// time constant in ms to the filter coefficient for one step of step frames
+static float agc_coeff(float time_ms, uint32_t rate, size_t step) {
+    if (time_ms <= 0 || rate == 0)
+        return 0;
+
+    return expf(-(float) step / (time_ms / 1000 * rate));
+}
+
+void agc_init(agc_t *agc, float target, float attack_ms, float release_ms, uint32_t rate, size_t step) {
+    *agc = (agc_t) {
+        .target = target,
+        .attack = agc_coeff(attack_ms, rate, step),
+        .release = agc_coeff(release_ms, rate, step),
+        .mean_square = 0,
+        .gain = 1,
+    };
+}
+
+// independent lanes so the compiler can vectorise the reduction without -ffast-math
+static float agc_mean_square(const float *samples, size_t n) {
+    float lanes[AGC_LANES] = {0};
+
+    size_t i = 0;
+    for (; i + AGC_LANES <= n; i += AGC_LANES) {
+        for (size_t j = 0; j < AGC_LANES; j++)
+            lanes[j] += samples[i + j] * samples[i + j];
+    }
+
+    float sum = 0;
+    for (; i < n; i++)
+        sum += samples[i] * samples[i];
+
+    for (size_t j = 0; j < AGC_LANES; j++)
+        sum += lanes[j];
+
+    return sum / n;
+}
+
+// boost is applied before measuring, same as scaling the samples up front
+void agc_process(agc_t *agc, float *samples, size_t n, float boost) {
+    if (n == 0)
+        return;
+
+    agc->level = agc_mean_square(samples, n);
+    float mean_square = agc->level * boost * boost;
+
+    // start from the first window instead of fading in from silence
+    if (agc->mean_square == 0)
+        agc->mean_square = mean_square;
+
+    float coeff = mean_square > agc->mean_square ? agc->attack : agc->release;
+    agc->mean_square = mean_square + coeff * (agc->mean_square - mean_square);
+
+    agc->gain = agc->mean_square > 0 ? MIN(agc->target / sqrtf(agc->mean_square), AGC_MAX_GAIN) : AGC_MAX_GAIN;
+
+    float scale = agc->gain * boost;
+    for (size_t i = 0; i < n; i++)
+        samples[i] *= scale;
+}
@@ -0,0 +1,359 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<math.h>
+#include<time.h>
+#include<semaphore.h>
+#include<stdatomic.h>
+
+#include "util.h"
+
+// how long the input has to stay below --silence-db before the analysis goes idle,
+//  the frames published meanwhile let the display settle on the silence
+#define SILENCE_HOLD_MS 1000
+
+// how many samples, over all channels, a window needs before the per channel stages are
+//  spread over the --workers pool, below it waking the workers costs more than it saves
+#define PARALLEL_MIN_SAMPLES 8192
+
+typedef struct {
+    ctx_t *ctx;
+    source_t *source;
+    analysis_frame_t *frame;
+} analysis_task_t;
+
+static void agc_task(void *_task, size_t channel, size_t worker) {
+    (void) worker;
+
+    analysis_task_t *task = _task;
+    analysis_frame_t *frame = task->frame;
+
+    agc_process(&task->source->agc[channel], frame->details[channel].samples, frame->n_samples, task->ctx->opts.sample_boost);
+}
+
+static void fft_task(void *_task, size_t channel, size_t worker) {
+    analysis_task_t *task = _task;
+    source_t *source = task->source;
+    channel_details_t *details = &task->frame->details[channel];
+
+    // each worker has its own stft scratch
+    stft_transform(&source->stft, worker, details->samples, details->fft);
+    band_map_apply(&source->bands, details->fft, details->bands);
+}
+
+// channels are independent from here on, one task each
+static void analysis_run(ctx_t *ctx, source_t *source, analysis_frame_t *frame, pool_fn fn) {
+    analysis_task_t task = { ctx, source, frame };
+
+    if (frame->n_channels * frame->n_samples >= PARALLEL_MIN_SAMPLES) {
+        pool_run(&ctx->pool, fn, &task, frame->n_channels);
+        return;
+    }
+
+    for (size_t i = 0; i < frame->n_channels; i++)
+        fn(&task, i, 0);
+}
+
+void process_samples(ctx_t *ctx, source_t *source, analysis_frame_t *frame) {
+    analysis_run(ctx, source, frame, agc_task);
+}
+
+void process_fft(ctx_t *ctx, source_t *source, analysis_frame_t *frame) {
+    analysis_run(ctx, source, frame, fft_task);
+}
+
+// true once every channel has been quiet for SILENCE_HOLD_MS, the agc already measured the level
+bool analysis_idle(ctx_t *ctx, source_t *source) {
+    for (size_t i = 0; i < source->n_channels; i++) {
+        if (source->agc[i].level > ctx->silence_level) {
+            if (ctx->opts.log_timings && source->silent_windows > 0)
+                fprintf(stderr, "analysis: source %zu: sound after %zu silent windows\n", source->index, source->silent_windows);
+
+            source->silent_windows = 0;
+            return false;
+        }
+    }
+
+    size_t hold = (uint64_t) SILENCE_HOLD_MS * source->stft.rate / (1000 * source->stft.hop);
+
+    if (++source->silent_windows == hold + 1 && ctx->opts.log_timings)
+        fprintf(stderr, "analysis: source %zu: silent for %dms, idle\n", source->index, SILENCE_HOLD_MS);
+
+    return source->silent_windows > hold;
+}
+
+// every published frame becomes one row of the waterfall, even those the renderer never gets to see,
+//  so its time axis stays even, rows are dropped if the renderer falls that far behind
+void spectrogram_push(source_t *source, analysis_frame_t *frame) {
+    uint32_t n_bands = frame->n_bands;
+    if (spsc_ring_writable(&source->rows) < sizeof(n_bands) + n_bands) {
+        spsc_ring_overrun(&source->rows);
+        return;
+    }
+
+    // 60dB below a peak that halves in about 3s at the default hop
+    spectrogram_row(frame->details, frame->n_channels, n_bands, source->row, &source->row_peak, 0.998, 60);
+
+    spsc_ring_put(&source->rows, 0, &n_bands, sizeof(n_bands));
+    spsc_ring_put(&source->rows, sizeof(n_bands), source->row, n_bands);
+    spsc_ring_commit(&source->rows, sizeof(n_bands) + n_bands);
+}
+
+// one hop worth of audio is in, turn the newest window into a frame
+void analyze_window(ctx_t *ctx, source_t *source, stream_time_t *time) {
+    // the back frame is only ever touched by this thread
+    analysis_frame_t *frame = frame_buffer_back(&source->frames);
+    frame_resize(frame, source->stft.size, source->bands.n_bands, source->n_channels);
+    frame->relevant_fft_bins = source->relevant_fft_bins;
+    frame->time = *time;
+
+    int64_t start = metrics_now();
+
+    for (size_t i = 0; i < source->n_channels; i++)
+        stft_window(&source->stft, i, frame->details[i].samples);
+
+    start = metrics_since_source(&ctx->metrics, source->index, METRIC_SPLIT, start);
+
+    process_samples(ctx, source, frame);
+
+    start = metrics_since_source(&ctx->metrics, source->index, METRIC_AGC, start);
+
+    // nothing to show, skip the fft and let the renderer sleep
+    if (analysis_idle(ctx, source))
+        return;
+
+    process_fft(ctx, source, frame);
+
+    metrics_since_source(&ctx->metrics, source->index, METRIC_FFT, start);
+
+    frame_buffer_publish(&source->frames);
+
+    if (ctx->opts.spectrogram)
+        spectrogram_push(source, frame);
+
+    if (ctx->exporter.map != NULL)
+        exporter_push(&ctx->exporter, source, frame);
+
+    sem_post(&ctx->render_wakeup);
+}
+
+// the stft, gain control and bands follow the stream's layout and rate
+static void analysis_configure(ctx_t *ctx, source_t *source, audio_chunk_t *chunk) {
+    uint32_t n_channels = chunk->n_channels;
+
+    if (source->n_channels != n_channels || source->stft.rate != chunk->rate) {
+        stft_reset(&source->stft, n_channels, chunk->rate);
+
+        // the filters step once per hop
+        for (size_t i = 0; i < n_channels; i++)
+            agc_init(&source->agc[i], ctx->opts.agc_target, ctx->opts.agc_attack_ms, ctx->opts.agc_release_ms, chunk->rate, source->stft.hop);
+
+        source->n_channels = n_channels;
+        source->relevant_fft_bins = (size_t) (20000.0 / ((double) chunk->rate / source->stft.size));
+        // only the first n / 2 + 1 bins are computed
+        source->relevant_fft_bins = MIN(source->relevant_fft_bins, rfft_bins(source->stft.plan));
+
+        band_map_build(&source->bands, chunk->rate, source->relevant_fft_bins);
+
+        printf("source %zu | channels: %d | rate: %d | fft size: %zu | hop: %zu | resolution: %.2fHz\n",
+                source->index, n_channels, chunk->rate, source->stft.size, source->stft.hop, (double) chunk->rate / source->stft.size);
+    }
+}
+
+// frames start to end of the chunk, frame 0 of the view is the chunk's frame start
+static void analyze_frames(ctx_t *ctx, source_t *source, audio_chunk_t *chunk, const sample_view_t *view, size_t start, size_t end) {
+    size_t n_frames = chunk->n_samples / chunk->n_channels;
+
+    size_t offset = start;
+    while (offset < end) {
+        offset += stft_feed(&source->stft, view, offset - start, end - offset);
+
+        if (stft_ready(&source->stft)) {
+            // the window ends offset frames into the chunk
+            stream_time_t time = chunk->time;
+            if (time.capture_ns != 0)
+                time.capture_ns -= (int64_t) (n_frames - offset) * NANOS_PER_SEC / chunk->rate;
+
+            analyze_window(ctx, source, &time);
+            stft_advance(&source->stft);
+        }
+    }
+}
+
+// samples are laid out as chunk says, see sample_view
+void analyze_chunk(ctx_t *ctx, source_t *source, audio_chunk_t *chunk, const void *samples) {
+    size_t n_frames = chunk->n_samples / chunk->n_channels;
+    sample_view_t view = sample_view(samples, chunk->format, chunk->planar, chunk->n_channels, n_frames);
+
+    analysis_configure(ctx, source, chunk);
+    analyze_frames(ctx, source, chunk, &view, 0, n_frames);
+}
+
+// the header and samples stay aligned from one chunk to the next, so samples can be read in place
+_Static_assert(sizeof(audio_chunk_t) % 8 == 0, "audio_chunk_t breaks the ring's alignment");
+
+// bytes a chunk with payload bytes of samples takes up in a source's ring
+size_t chunk_ring_size(size_t payload) {
+    return sizeof(audio_chunk_t) + ((payload + 7) & ~(size_t) 7);
+}
+
+// the chunk at the tail of the ring, read in place, so the samples are only ever copied in on_process
+//  fed in runs of frames that don't cross the end of the ring, an interleaved chunk is cut where the end
+//  falls and after the frame it splits, a planar one where it splits the one plane it falls in
+static void analyze_ring_chunk(ctx_t *ctx, source_t *source, audio_chunk_t *chunk) {
+    uint32_t n_channels = chunk->n_channels;
+    size_t n_frames = chunk->n_samples / n_channels;
+    size_t bytes = sample_size(chunk->format);
+
+    size_t contiguous;
+    spsc_ring_peek(&source->ring, sizeof(*chunk), &contiguous);
+
+    // samples before the end of the ring, every chunk starts aligned so none is split
+    size_t wrap = contiguous / bytes;
+
+    size_t cuts[4] = { 0, n_frames, n_frames, n_frames };
+    if (wrap < chunk->n_samples && chunk->planar)
+        cuts[1] = wrap % n_frames;
+    else if (wrap < chunk->n_samples) {
+        cuts[1] = wrap / n_channels;
+        cuts[2] = (wrap + n_channels - 1) / n_channels;
+    }
+
+    analysis_configure(ctx, source, chunk);
+
+    for (size_t i = 0; i < 3; i++) {
+        size_t start = cuts[i];
+        size_t end = cuts[i + 1];
+        if (start >= end)
+            continue;
+
+        sample_view_t view = {
+            .format = chunk->format,
+            .stride = chunk->planar ? 1 : n_channels,
+        };
+
+        for (size_t c = 0; c < n_channels; c++) {
+            size_t index = chunk->planar ? c * n_frames + start : start * n_channels + c;
+            view.channels[c] = spsc_ring_peek(&source->ring, sizeof(*chunk) + index * bytes, NULL);
+        }
+
+        analyze_frames(ctx, source, chunk, &view, start, end);
+    }
+}
+
+// everything queued by one source's on_process so far
+static void analysis_drain(ctx_t *ctx, source_t *source) {
+    audio_chunk_t chunk;
+    while (spsc_ring_readable(&source->ring) >= sizeof(chunk)) {
+        spsc_ring_get(&source->ring, 0, &chunk, sizeof(chunk));
+
+        int64_t start = metrics_since_source(&ctx->metrics, source->index, METRIC_QUEUE, chunk.queued_ns);
+
+        if (chunk.n_channels > 0 && chunk.n_channels <= MAX_CHANNELS && chunk.n_samples >= chunk.n_channels)
+            analyze_ring_chunk(ctx, source, &chunk);
+
+        // only now, on_process may overwrite the samples as soon as they're consumed
+        spsc_ring_consume(&source->ring, chunk_ring_size(chunk.n_samples * sample_size(chunk.format)));
+
+        metrics_since_source(&ctx->metrics, source->index, METRIC_ANALYSIS, start);
+    }
+}
+
+// consumes chunks queued by on_process and runs them through the dsp pipeline,
+//  one thread for every source, they take turns chunk by chunk
+void *analysis_thread_init(void *_ctx) {
+    ctx_t *ctx = _ctx;
+
+    while (!atomic_load(&ctx->analysis_quit)) {
+        sem_wait(&ctx->analysis_wakeup);
+
+        for (size_t i = 0; i < ctx->n_sources; i++)
+            analysis_drain(ctx, &ctx->sources[i]);
+    }
+
+    return NULL;
+}
+
+// everything analyze_chunk needs for every source, the frames are freed separately as the renderer may outlive this
+void analysis_init(ctx_t *ctx) {
+    ctx->n_sources = MIN(MAX(ctx->n_sources, 1), MAX_SOURCES);
+
+    pool_init(&ctx->pool, MAX(ctx->opts.workers, 0));
+
+    for (size_t i = 0; i < ctx->n_sources; i++) {
+        source_t *source = &ctx->sources[i];
+        source->ctx = ctx;
+        source->index = i;
+
+        // one scratch per worker, including the analysis thread itself
+        stft_init(&source->stft, MAX(ctx->opts.fft_size, 1), MAX(ctx->opts.hop, 1), ctx->pool.n_threads + 1);
+        band_map_init(&source->bands, ctx->opts.band_scale, MAX(ctx->opts.n_bands, 1), source->stft.size);
+        frame_buffer_init(&source->frames);
+
+        source->silent_windows = 0;
+
+        // enough for every row the waterfall shows
+        if (ctx->opts.spectrogram) {
+            spsc_ring_init(&source->rows, MAX(ctx->opts.history, 1) * (sizeof(uint32_t) + source->bands.max_bands));
+            source->row = malloc(source->bands.max_bands);
+            source->row_peak = 0;
+        }
+    }
+
+    // dBFS to a mean square
+    ctx->silence_level = powf(10, ctx->opts.silence_db / 10);
+
+    sem_init(&ctx->render_wakeup, 0, 0);
+}
+
+void analysis_free(ctx_t *ctx) {
+    pool_free(&ctx->pool);
+
+    for (size_t i = 0; i < ctx->n_sources; i++) {
+        stft_free(&ctx->sources[i].stft);
+        band_map_free(&ctx->sources[i].bands);
+    }
+
+    sem_destroy(&ctx->render_wakeup);
+}
+
+// and the spectrogram rows, the renderer reads both
+void analysis_free_frames(ctx_t *ctx) {
+    for (size_t i = 0; i < ctx->n_sources; i++) {
+        frame_buffer_free(&ctx->sources[i].frames);
+
+        if (ctx->opts.spectrogram) {
+            spsc_ring_free(&ctx->sources[i].rows);
+            free(ctx->sources[i].row);
+        }
+    }
+}
+
+void analysis_thread_start(ctx_t *ctx, pthread_t *tid) {
+    analysis_init(ctx);
+
+    for (size_t i = 0; i < ctx->n_sources; i++)
+        spsc_ring_init(&ctx->sources[i].ring, (size_t) ctx->opts.ring_kib * 1024);
+
+    sem_init(&ctx->analysis_wakeup, 0, 0);
+    atomic_init(&ctx->analysis_quit, false);
+
+    pthread_create(tid, NULL, analysis_thread_init, ctx);
+}
+
+void analysis_thread_stop(ctx_t *ctx, pthread_t tid) {
+    atomic_store(&ctx->analysis_quit, true);
+    sem_post(&ctx->analysis_wakeup);
+
+    pthread_join(tid, NULL);
+
+    for (size_t i = 0; i < ctx->n_sources; i++) {
+        if (ctx->opts.log_timings)
+            print_ring_stats(i, &ctx->sources[i].ring);
+
+        spsc_ring_free(&ctx->sources[i].ring);
+    }
+
+    sem_destroy(&ctx->analysis_wakeup);
+    analysis_free(ctx);
+}
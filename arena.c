@@ -0,0 +1,52 @@
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<assert.h>
+
+#include "dsp.h"
+
+// bump allocator, sized once up front
+//  everything handed out lives until the next arena_reset, so changing the
+//  layout of a buffer means re-slicing the arena instead of calling the allocator
+
+#define ARENA_ALIGN 32
+
+static size_t arena_align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+}
+
+void arena_init(arena_t *arena, size_t capacity) {
+    capacity = arena_align_up(MAX(capacity, 1));
+
+    arena->base = aligned_alloc(ARENA_ALIGN, capacity);
+    arena->capacity = capacity;
+    arena->used = 0;
+}
+
+void arena_free(arena_t *arena) {
+    free(arena->base);
+
+    *arena = (arena_t) {0};
+}
+
+void arena_reset(arena_t *arena) {
+    arena->used = 0;
+}
+
+// zeroed and aligned for simd, running out of space is a sizing bug
+void *arena_alloc(arena_t *arena, size_t bytes) {
+    bytes = arena_align_up(bytes);
+    assert(arena->used + bytes <= arena->capacity);
+
+    void *ptr = arena->base + arena->used;
+    arena->used += bytes;
+
+    memset(ptr, 0, bytes);
+
+    return ptr;
+}
+
+// worst case space taken by n allocations totalling bytes, for sizing arenas
+size_t arena_size_for(size_t bytes, size_t n) {
+    return bytes + n * ARENA_ALIGN;
+}
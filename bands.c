@@ -0,0 +1,182 @@
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+#include<assert.h>
+
+#include "dsp.h"
+
+// maps fft bins onto display bands on a perceptual frequency scale
+//  the bin -> band weights are worked out once per (rate, fft size, band count),
+//  after that every frame is a single linear pass over the magnitudes
+
+// lowest frequency shown on the non linear scales
+#define BANDS_MIN_FREQ 20.0
+
+const char *band_scale_names[] = {
+    [BAND_SCALE_LINEAR] = "linear",
+    [BAND_SCALE_LOG] = "log",
+    [BAND_SCALE_OCTAVE] = "octave",
+    [BAND_SCALE_MEL] = "mel",
+    [BAND_SCALE_BARK] = "bark",
+};
+
+// returns -1 for unknown names
+int band_scale_parse(const char *name) {
+    for (size_t i = 0; i < sizeof(band_scale_names) / sizeof(*band_scale_names); i++) {
+        if (!strcmp(name, band_scale_names[i]))
+            return i;
+    }
+
+    return -1;
+}
+
+static double band_warp(band_scale_t scale, double freq) {
+    switch (scale) {
+        case BAND_SCALE_LOG:
+        case BAND_SCALE_OCTAVE:
+            return log2(freq);
+        case BAND_SCALE_MEL:
+            return 2595 * log10(1 + freq / 700);
+        case BAND_SCALE_BARK:
+            // Traunmüller
+            return 26.81 * freq / (1960 + freq) - 0.53;
+        case BAND_SCALE_LINEAR:
+        default:
+            return freq;
+    }
+}
+
+static double band_unwarp(band_scale_t scale, double value) {
+    switch (scale) {
+        case BAND_SCALE_LOG:
+        case BAND_SCALE_OCTAVE:
+            return exp2(value);
+        case BAND_SCALE_MEL:
+            return 700 * (pow(10, value / 2595) - 1);
+        case BAND_SCALE_BARK:
+            return 1960 * (value + 0.53) / (26.28 - value);
+        case BAND_SCALE_LINEAR:
+        default:
+            return value;
+    }
+}
+
+void band_map_init(band_map_t *map, band_scale_t scale, size_t n_bands, size_t fft_size) {
+    n_bands = MAX(n_bands, 1);
+
+    // wide bands touch at most two bins past their width, narrow ones interpolate between two
+    size_t capacity = fft_size / 2 + 1 + 2 * n_bands + 2;
+
+    *map = (band_map_t) {
+        .scale = scale,
+        .max_bands = n_bands,
+        .fft_size = fft_size,
+        .entries = malloc(capacity * sizeof(*map->entries)),
+        .capacity = capacity,
+    };
+}
+
+void band_map_free(band_map_t *map) {
+    free(map->entries);
+
+    *map = (band_map_t) {0};
+}
+
+static void band_map_push(band_map_t *map, size_t band, size_t bin, float weight) {
+    assert(map->n_entries < map->capacity);
+
+    map->entries[map->n_entries++] = (band_entry_t) {
+        .bin = bin,
+        .band = band,
+        .weight = weight,
+    };
+}
+
+// band edges in bin units, lo..hi, bin k covers [k - 0.5, k + 0.5)
+static void band_map_add(band_map_t *map, size_t band, double lo, double hi, size_t n_bins) {
+    double width = hi - lo;
+    size_t start = map->n_entries;
+
+    if (width < 1) {
+        // narrower than a bin, interpolate at the centre
+        double center = MIN((lo + hi) / 2, n_bins - 1);
+        size_t k = center;
+        float t = center - k;
+
+        band_map_push(map, band, k, 1 - t);
+        if (t > 0 && k + 1 < n_bins)
+            band_map_push(map, band, k + 1, t);
+    } else {
+        size_t first = MAX(floor(lo + 0.5), 0);
+        size_t last = MIN(ceil(hi - 0.5), n_bins - 1);
+
+        for (size_t k = first; k <= last; k++) {
+            double overlap = MIN(hi, k + 0.5) - MAX(lo, k - 0.5);
+            if (overlap > 0)
+                band_map_push(map, band, k, overlap);
+        }
+    }
+
+    // bands cut off at either end still average what they do cover
+    float total = 0;
+    for (size_t i = start; i < map->n_entries; i++)
+        total += map->entries[i].weight;
+
+    for (size_t i = start; i < map->n_entries; i++)
+        map->entries[i].weight /= total;
+}
+
+// rebuilds the table for the first n_bins bins of an fft at this rate
+void band_map_build(band_map_t *map, uint32_t rate, size_t n_bins) {
+    double bin_hz = (double) rate / map->fft_size;
+    double max_freq = n_bins * bin_hz;
+    double min_freq = map->scale == BAND_SCALE_LINEAR ? 0 : MIN(BANDS_MIN_FREQ, max_freq / 2);
+
+    map->rate = rate;
+    map->n_bins = n_bins;
+    map->n_entries = 0;
+
+    if (map->scale == BAND_SCALE_OCTAVE) {
+        // 1/n octave bands centred on 1kHz, n picked so they fill max_bands as well as possible
+        double octaves = log2(max_freq / min_freq);
+        size_t fraction = MAX(floor(map->max_bands / octaves), 1);
+
+        long first = ceil(fraction * log2(min_freq / 1000));
+        long last = floor(fraction * log2(max_freq / 1000));
+
+        map->n_bands = 0;
+        for (long k = first; k <= last && map->n_bands < map->max_bands; k++) {
+            double center = 1000 * exp2((double) k / fraction);
+            double half = exp2(0.5 / fraction);
+
+            band_map_add(map, map->n_bands++, center / half / bin_hz, center * half / bin_hz, n_bins);
+        }
+
+        return;
+    }
+
+    double lo = band_warp(map->scale, min_freq);
+    double hi = band_warp(map->scale, max_freq);
+
+    // the linear scale covers every bin, dc included
+    double offset = map->scale == BAND_SCALE_LINEAR ? 0.5 : 0;
+
+    map->n_bands = map->max_bands;
+    for (size_t i = 0; i < map->n_bands; i++) {
+        double f_lo = band_unwarp(map->scale, lo + (hi - lo) * i / map->n_bands);
+        double f_hi = band_unwarp(map->scale, lo + (hi - lo) * (i + 1) / map->n_bands);
+
+        band_map_add(map, i, f_lo / bin_hz - offset, f_hi / bin_hz - offset, n_bins);
+    }
+}
+
+// writes map->n_bands values, entries are built in increasing frequency so magnitudes are read front to back
+void band_map_apply(band_map_t *map, const float *magnitudes, float *dst) {
+    memset(dst, 0, map->n_bands * sizeof(float));
+
+    for (size_t i = 0; i < map->n_entries; i++) {
+        band_entry_t entry = map->entries[i];
+        dst[entry.band] += magnitudes[entry.bin] * entry.weight;
+    }
+}
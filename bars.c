@@ -0,0 +1,242 @@
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<raylib.h>
+
+#include "util.h"
+
+// --renderer shader, the bars and waveforms of a panel in a single draw call
+//  everything a panel shows goes into one float texture, the waveforms' min/max columns in the first rows
+//  and a row of bar heights per spectrum after them, uploaded with one UpdateTextureRec, then a single quad
+//  covers the panel and the fragment shader works out which bar or column each pixel falls in,
+//  the shapes are the same the immediate renderer draws rectangle by rectangle
+
+// min and max row for each of the two waveforms
+#define BARS_WAVE_ROWS 4
+#define BARS_ROWS (BARS_WAVE_ROWS + MAX_CHANNELS)
+
+const char *renderer_names[] = {
+    [RENDERER_IMMEDIATE] = "immediate",
+    [RENDERER_SHADER] = "shader",
+};
+
+int renderer_parse(const char *name) {
+    for (size_t i = 0; i < sizeof(renderer_names) / sizeof(*renderer_names); i++) {
+        if (!strcmp(name, renderer_names[i]))
+            return i;
+    }
+
+    return -1;
+}
+
+// bars are drawn over the waveforms and the second waveform over the first, like the immediate renderer does,
+//  spectra start at row 4 (BARS_WAVE_ROWS) and the waveform scale and thickness are render_samples' 40 and 2
+static const char *bars_fs =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform sampler2D lut;\n"
+    "uniform vec2 size;\n"
+    "uniform int n_bands;\n"
+    "uniform float chunk;\n"
+    "uniform float bar_width;\n"
+    "uniform int mirror_row;\n"
+    "uniform int strips;\n"
+    "uniform vec4 bar_color;\n"
+    "uniform int n_waves;\n"
+    "uniform int columns;\n"
+    "uniform vec2 centerlines;\n"
+    "uniform vec2 peaks;\n"
+    "out vec4 finalColor;\n"
+    "float value(int row, int i) {\n"
+    "    return texelFetch(texture0, ivec2(i, row), 0).r;\n"
+    "}\n"
+    "vec4 progression(int row, float progress) {\n"
+    "    return texelFetch(lut, ivec2(int(clamp(progress, 0.0, 1.0) * 255.0 + 0.5), row), 0);\n"
+    "}\n"
+    "bool bar(int row, float x, float y, float base, float top, float bottom) {\n"
+    "    int i = int(x / chunk);\n"
+    "    if (x < 0.0 || i >= n_bands || x < chunk * float(i + 1) - bar_width)\n"
+    "        return false;\n"
+    "    return y >= max(base - value(4 + row, i), top) && y < bottom;\n"
+    "}\n"
+    "bool wave(int w, vec2 p, out vec4 color) {\n"
+    "    int i = int(p.x * float(columns) / size.x);\n"
+    "    if (w >= n_waves || i >= columns)\n"
+    "        return false;\n"
+    "    float lo = value(w * 2, i);\n"
+    "    float hi = value(w * 2 + 1, i);\n"
+    "    float top = centerlines[w] - hi * 40.0 - 1.0;\n"
+    "    float bottom = centerlines[w] - lo * 40.0 + 1.0;\n"
+    "    float level = max(abs(lo), abs(hi));\n"
+    "    color = progression(w, peaks[w] > 0.0 ? level / peaks[w] : 0.0);\n"
+    "    return p.y >= top && p.y < bottom;\n"
+    "}\n"
+    "void main() {\n"
+    "    vec2 p = fragTexCoord * size;\n"
+    "    vec4 color = vec4(0.0);\n"
+    "    if (strips > 0) {\n"
+    "        float height = size.y / float(strips);\n"
+    "        int c = min(int(p.y / height), strips - 1);\n"
+    "        float top = height * float(c);\n"
+    "        float bottom = top + height - 1.0;\n"
+    "        if (bar(c, p.x, p.y, bottom, top, bottom))\n"
+    "            color = progression(0, strips > 1 ? float(c) / float(strips - 1) : 0.0);\n"
+    "    } else {\n"
+    "        vec4 wave_color;\n"
+    "        if (wave(1, p, wave_color) || wave(0, p, wave_color))\n"
+    "            color = wave_color;\n"
+    "        if (bar(0, p.x, p.y, size.y - 1.0, 0.0, size.y) || (mirror_row >= 0 && bar(mirror_row, size.x - p.x, p.y, size.y - 1.0, 0.0, size.y)))\n"
+    "            color = bar_color;\n"
+    "    }\n"
+    "    finalColor = color * fragColor;\n"
+    "}\n";
+
+typedef struct {
+    Texture2D texture;
+    Texture2D lut;
+    Shader shader;
+
+    int lut_loc;
+    int size_loc;
+    int n_bands_loc;
+    int chunk_loc;
+    int bar_width_loc;
+    int mirror_row_loc;
+    int strips_loc;
+    int bar_color_loc;
+    int n_waves_loc;
+    int columns_loc;
+    int centerlines_loc;
+    int peaks_loc;
+
+    // texture.width floats per row, BARS_ROWS rows
+    float *staging;
+
+    // what the next bars_draw shows, set by bars_wave and bars_spectrum
+    size_t n_bands;
+    size_t n_rows;
+    int n_waves;
+    int columns;
+    float centerlines[2];
+    float peaks[2];
+} bars_t;
+
+// has to run on the thread that owns the window, width is the most bands or columns a row holds
+void bars_init(bars_t *bars, size_t width, const palette_t *palettes) {
+    *bars = (bars_t) {
+        .staging = calloc(width * BARS_ROWS, sizeof(float)),
+    };
+
+    Image image = {
+        .data = bars->staging,
+        .width = width,
+        .height = BARS_ROWS,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R32,
+    };
+
+    bars->texture = LoadTextureFromImage(image);
+
+    // the first waveform and the strips use the first row, the second waveform the other one,
+    //  the two palettes are back to back already
+    Image lut_image = {
+        .data = (void *) palettes,
+        .width = PALETTE_SIZE,
+        .height = 2,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+
+    bars->lut = LoadTextureFromImage(lut_image);
+
+    bars->shader = LoadShaderFromMemory(NULL, bars_fs);
+    bars->lut_loc = GetShaderLocation(bars->shader, "lut");
+    bars->size_loc = GetShaderLocation(bars->shader, "size");
+    bars->n_bands_loc = GetShaderLocation(bars->shader, "n_bands");
+    bars->chunk_loc = GetShaderLocation(bars->shader, "chunk");
+    bars->bar_width_loc = GetShaderLocation(bars->shader, "bar_width");
+    bars->mirror_row_loc = GetShaderLocation(bars->shader, "mirror_row");
+    bars->strips_loc = GetShaderLocation(bars->shader, "strips");
+    bars->bar_color_loc = GetShaderLocation(bars->shader, "bar_color");
+    bars->n_waves_loc = GetShaderLocation(bars->shader, "n_waves");
+    bars->columns_loc = GetShaderLocation(bars->shader, "columns");
+    bars->centerlines_loc = GetShaderLocation(bars->shader, "centerlines");
+    bars->peaks_loc = GetShaderLocation(bars->shader, "peaks");
+}
+
+void bars_free(bars_t *bars) {
+    UnloadTexture(bars->texture);
+    UnloadTexture(bars->lut);
+    UnloadShader(bars->shader);
+    free(bars->staging);
+}
+
+// forgets the last panel's waveforms and spectra
+void bars_reset(bars_t *bars) {
+    bars->n_bands = 0;
+    bars->n_rows = 0;
+    bars->n_waves = 0;
+    bars->columns = 0;
+}
+
+// index 0 or 1, every waveform of a panel has the same number of columns
+void bars_wave(bars_t *bars, size_t index, float *min, float *max, size_t columns, float peak, float centerline) {
+    float *row = bars->staging + index * 2 * bars->texture.width;
+
+    memcpy(row, min, columns * sizeof(float));
+    memcpy(row + bars->texture.width, max, columns * sizeof(float));
+
+    bars->columns = columns;
+    bars->centerlines[index] = centerline;
+    bars->peaks[index] = peak;
+    bars->n_waves = MAX(bars->n_waves, (int) index + 1);
+}
+
+// bar heights in pixels, the scale fill_vector_from_samples would use
+void bars_spectrum(bars_t *bars, size_t index, float *bands, size_t n_bands, float scale) {
+    float *row = bars->staging + (BARS_WAVE_ROWS + index) * bars->texture.width;
+
+    for (size_t i = 0; i < n_bands; i++)
+        row[i] = bands[i] * scale;
+
+    bars->n_bands = n_bands;
+    bars->n_rows = MAX(bars->n_rows, index + 1);
+}
+
+// mirror_row is the spectrum drawn right to left, -1 for none, strips puts every spectrum in a strip of its own
+void bars_draw(bars_t *bars, float width, float height, int mirror_row, bool strips, Color color) {
+    if (bars->n_bands == 0 && bars->n_waves == 0)
+        return;
+
+    // only the rows in use, they're contiguous in the staging buffer
+    int rows = BARS_WAVE_ROWS + bars->n_rows;
+    UpdateTextureRec(bars->texture, (Rectangle) { 0, 0, bars->texture.width, rows }, bars->staging);
+
+    Vector2 size = { width, height };
+    int n_bands = bars->n_bands;
+    // the immediate renderer rounds the bar width down and spreads the bars over the whole width
+    float chunk = bars->n_bands > 0 ? width / bars->n_bands : 1;
+    float bar_width = bars->n_bands > 0 ? (int) width / (int) bars->n_bands : 0;
+    int n_strips = strips ? bars->n_rows : 0;
+    Vector4 bar_color = ColorNormalize(color);
+
+    BeginShaderMode(bars->shader);
+    SetShaderValueTexture(bars->shader, bars->lut_loc, bars->lut);
+    SetShaderValue(bars->shader, bars->size_loc, &size, SHADER_UNIFORM_VEC2);
+    SetShaderValue(bars->shader, bars->n_bands_loc, &n_bands, SHADER_UNIFORM_INT);
+    SetShaderValue(bars->shader, bars->chunk_loc, &chunk, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(bars->shader, bars->bar_width_loc, &bar_width, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(bars->shader, bars->mirror_row_loc, &mirror_row, SHADER_UNIFORM_INT);
+    SetShaderValue(bars->shader, bars->strips_loc, &n_strips, SHADER_UNIFORM_INT);
+    SetShaderValue(bars->shader, bars->bar_color_loc, &bar_color, SHADER_UNIFORM_VEC4);
+    SetShaderValue(bars->shader, bars->n_waves_loc, &bars->n_waves, SHADER_UNIFORM_INT);
+    SetShaderValue(bars->shader, bars->columns_loc, &bars->columns, SHADER_UNIFORM_INT);
+    SetShaderValue(bars->shader, bars->centerlines_loc, bars->centerlines, SHADER_UNIFORM_VEC2);
+    SetShaderValue(bars->shader, bars->peaks_loc, bars->peaks, SHADER_UNIFORM_VEC2);
+
+    Rectangle source = { 0, 0, bars->texture.width, bars->texture.height };
+    DrawTexturePro(bars->texture, source, (Rectangle) { 0, 0, width, height }, (Vector2) { 0, 0 }, 0, WHITE);
+    EndShaderMode();
+}
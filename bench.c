@@ -0,0 +1,492 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+#include<time.h>
+#include<unistd.h>
+
+// layout compatible with Raylib's, see reduce.c
+typedef struct Vector2 {
+    float x;
+    float y;
+} Vector2;
+
+#include "dsp.h"
+#include "fft.c"
+#include "arena.c"
+#include "convert.c"
+#include "ring.c"
+#include "stft.c"
+#include "agc.c"
+#include "bands.c"
+#include "reduce.c"
+#include "pool.c"
+
+// standalone, doesn't need PipeWire or a window
+//  times every dsp and reduction kernel over a sweep of frame counts, channel counts and signals,
+//  and checks the planned fft against the recursive reference and the simd kernels against the scalar ones
+//
+// output is tab separated with a header line, one row per kernel/signal/frames/channels:
+//  ns per call at the 50th/90th/99th percentile of BENCH_BATCHES batches, ns per frame and frames/s at the median,
+//  max_err is the largest difference to the reference where there is one,
+//  the simd kernels picked for this cpu go to stderr
+//
+// usage: visualizer-bench [kernel name filter]
+
+#define BENCH_BATCHES 64
+// each timed batch repeats the kernel until it takes at least this long, so clock overhead doesn't matter
+#define BENCH_BATCH_NS 20000
+#define BENCH_MAX_CHANNELS 8
+#define BENCH_COLUMNS 1920
+#define BENCH_BANDS 256
+#define BENCH_RATE 48000
+
+typedef enum {
+    SIGNAL_SINE,
+    SIGNAL_NOISE,
+    SIGNAL_SILENCE,
+} signal_t;
+
+static const char *signal_names[] = {
+    [SIGNAL_SINE] = "sine",
+    [SIGNAL_NOISE] = "noise",
+    [SIGNAL_SILENCE] = "silence",
+};
+
+typedef struct {
+    size_t frames;
+    size_t channels;
+
+    // frames * channels interleaved, like PipeWire hands them over
+    float *interleaved;
+    int16_t *interleaved_s16;
+    int32_t *interleaved_s32;
+    // one channel after the other, like the planar formats
+    float *planar;
+    channel_details_t details[BENCH_MAX_CHANNELS];
+    channel_details_t merged;
+
+    complex_t *complex_src;
+    complex_t *complex_work;
+    float *re;
+    float *im;
+
+    fft_plan_t *plan;
+    rfft_plan_t *rplan_scalar;
+    rfft_plan_t *rplan;
+    float *real;
+    float *imag;
+    float *mag;
+
+    stft_t stft;
+    agc_t agc[BENCH_MAX_CHANNELS];
+    band_map_t bands;
+
+    float *min;
+    float *max;
+    Vector2 *coords;
+} bench_state_t;
+
+typedef void (*bench_fn)(bench_state_t *);
+
+// shared by every run, sized like the visualizer's default --workers
+static pool_t pool;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec * NANOS_PER_SEC + ts.tv_nsec;
+}
+
+static float signal_sample(signal_t signal, size_t i, size_t channel, uint32_t *rng) {
+    switch (signal) {
+        case SIGNAL_SINE:
+            return sinf(2 * M_PI * 440 * (i + channel * 7) / BENCH_RATE) + 0.5f * sinf(2 * M_PI * 3000 * i / BENCH_RATE);
+        case SIGNAL_NOISE:
+            // xorshift32, uniform in [-1, 1)
+            *rng ^= *rng << 13;
+            *rng ^= *rng >> 17;
+            *rng ^= *rng << 5;
+            return *rng / 2147483648.0f - 1;
+        case SIGNAL_SILENCE:
+        default:
+            return 0;
+    }
+}
+
+static float *bench_floats(size_t n) {
+    return calloc(MAX(n, 1), sizeof(float));
+}
+
+static void bench_state_init(bench_state_t *s, size_t frames, size_t channels, signal_t signal) {
+    *s = (bench_state_t) {
+        .frames = frames,
+        .channels = channels,
+    };
+
+    uint32_t rng = 0x9e3779b9;
+
+    s->interleaved = bench_floats(frames * channels);
+    s->interleaved_s16 = malloc(frames * channels * sizeof(int16_t));
+    s->interleaved_s32 = malloc(frames * channels * sizeof(int32_t));
+    s->planar = bench_floats(frames * channels);
+    for (size_t i = 0; i < frames; i++) {
+        for (size_t j = 0; j < channels; j++) {
+            float sample = signal_sample(signal, i, j, &rng);
+
+            s->interleaved[i * channels + j] = sample;
+            s->interleaved_s16[i * channels + j] = sample * 32767;
+            s->interleaved_s32[i * channels + j] = sample * 2147483520.0f;
+            s->planar[j * frames + i] = sample;
+        }
+    }
+
+    for (size_t j = 0; j < channels; j++) {
+        s->details[j].samples = bench_floats(frames);
+        s->details[j].fft = bench_floats(frames);
+        s->details[j].bands = bench_floats(BENCH_BANDS);
+
+        for (size_t i = 0; i < frames; i++)
+            s->details[j].samples[i] = s->interleaved[i * channels + j];
+    }
+
+    s->merged.samples = bench_floats(frames);
+    s->merged.bands = bench_floats(BENCH_BANDS);
+
+    s->complex_src = malloc(frames * sizeof(*s->complex_src));
+    s->complex_work = malloc(frames * sizeof(*s->complex_work));
+    s->re = bench_floats(frames);
+    s->im = bench_floats(frames);
+    for (size_t i = 0; i < frames; i++)
+        s->complex_src[i] = (complex_t) { s->details[0].samples[i], 0 };
+
+    s->plan = fft_plan_new(frames);
+    s->rplan_scalar = rfft_plan_new(frames);
+    s->rplan = rfft_plan_new(frames);
+    rfft_plan_set_kernels(s->rplan_scalar, &fft_kernels_scalar);
+
+    size_t n_bins = rfft_bins(s->rplan);
+    s->real = bench_floats(n_bins);
+    s->imag = bench_floats(n_bins);
+    s->mag = bench_floats(n_bins);
+
+    // one window per call, the same as a hop of the whole window
+    stft_init(&s->stft, frames, frames, pool.n_threads + 1);
+    stft_reset(&s->stft, channels, BENCH_RATE);
+
+    for (size_t j = 0; j < channels; j++)
+        agc_init(&s->agc[j], 1.2, 300, 3000, BENCH_RATE, frames);
+
+    size_t relevant_bins = MIN((size_t) (20000.0 / ((double) BENCH_RATE / frames)), n_bins);
+    band_map_init(&s->bands, BAND_SCALE_LOG, BENCH_BANDS, frames);
+    band_map_build(&s->bands, BENCH_RATE, relevant_bins);
+
+    // magnitudes for the band mapping
+    stft_transform(&s->stft, 0, s->details[0].samples, s->details[0].fft);
+
+    s->min = bench_floats(BENCH_COLUMNS);
+    s->max = bench_floats(BENCH_COLUMNS);
+    s->coords = malloc(frames * sizeof(*s->coords));
+}
+
+static void bench_state_free(bench_state_t *s) {
+    free(s->interleaved);
+    free(s->interleaved_s16);
+    free(s->interleaved_s32);
+    free(s->planar);
+    for (size_t j = 0; j < s->channels; j++) {
+        free(s->details[j].samples);
+        free(s->details[j].fft);
+        free(s->details[j].bands);
+    }
+
+    free(s->merged.samples);
+    free(s->merged.bands);
+    free(s->complex_src);
+    free(s->complex_work);
+    free(s->re);
+    free(s->im);
+    fft_plan_free(s->plan);
+    rfft_plan_free(s->rplan_scalar);
+    rfft_plan_free(s->rplan);
+    free(s->real);
+    free(s->imag);
+    free(s->mag);
+    stft_free(&s->stft);
+    band_map_free(&s->bands);
+    free(s->min);
+    free(s->max);
+    free(s->coords);
+}
+
+// kernels, each one call is what the analysis or render thread does per window
+
+static void bench_fft_recursive(bench_state_t *s) {
+    memcpy(s->complex_work, s->complex_src, s->frames * sizeof(*s->complex_work));
+    fft_recursive(complex_arr_new(s->complex_work, s->frames));
+}
+
+static void bench_fft(bench_state_t *s) {
+    for (size_t i = 0; i < s->frames; i++) {
+        s->re[i] = s->complex_src[i].real;
+        s->im[i] = s->complex_src[i].imag;
+    }
+
+    fft(s->plan, s->re, s->im);
+}
+
+static void bench_fft_samples_scalar(bench_state_t *s) {
+    fft_samples(s->rplan_scalar, s->details[0].samples, s->real, s->imag);
+    fft_magnitudes(s->rplan_scalar, s->real, s->imag, s->mag, rfft_bins(s->rplan_scalar));
+}
+
+static void bench_fft_samples(bench_state_t *s) {
+    fft_samples(s->rplan, s->details[0].samples, s->real, s->imag);
+    fft_magnitudes(s->rplan, s->real, s->imag, s->mag, rfft_bins(s->rplan));
+}
+
+static void bench_stft_transform(bench_state_t *s) {
+    stft_transform(&s->stft, 0, s->details[0].samples, s->details[0].fft);
+}
+
+// replaces split_sample_channels, the variants take the other formats PipeWire may negotiate
+static void bench_split_view(bench_state_t *s, const sample_view_t *view) {
+    size_t offset = 0;
+    while (offset < s->frames) {
+        offset += stft_feed(&s->stft, view, offset, s->frames - offset);
+
+        if (stft_ready(&s->stft)) {
+            for (size_t j = 0; j < s->channels; j++)
+                stft_window(&s->stft, j, s->details[j].samples);
+
+            stft_advance(&s->stft);
+        }
+    }
+}
+
+static void bench_stft_split(bench_state_t *s) {
+    sample_view_t view = sample_view(s->interleaved, SAMPLE_F32, false, s->channels, s->frames);
+    bench_split_view(s, &view);
+}
+
+static void bench_stft_split_f32p(bench_state_t *s) {
+    sample_view_t view = sample_view(s->planar, SAMPLE_F32, true, s->channels, s->frames);
+    bench_split_view(s, &view);
+}
+
+static void bench_stft_split_s16(bench_state_t *s) {
+    sample_view_t view = sample_view(s->interleaved_s16, SAMPLE_S16, false, s->channels, s->frames);
+    bench_split_view(s, &view);
+}
+
+static void bench_stft_split_s32(bench_state_t *s) {
+    sample_view_t view = sample_view(s->interleaved_s32, SAMPLE_S32, false, s->channels, s->frames);
+    bench_split_view(s, &view);
+}
+
+// replaces normalize_samples
+static void bench_agc(bench_state_t *s) {
+    for (size_t j = 0; j < s->channels; j++)
+        agc_process(&s->agc[j], s->details[j].samples, s->frames, 1);
+}
+
+static void bench_merge_channels(bench_state_t *s) {
+    merge_channels(s->details, &s->merged, s->frames, s->bands.n_bands, s->channels);
+}
+
+// replaces avg_reduce_stream
+static void bench_band_map(bench_state_t *s) {
+    band_map_apply(&s->bands, s->details[0].fft, s->details[0].bands);
+}
+
+// what analyze_window does per channel after the split, serially and over the pool,
+//  the difference is what fanning out saves (or costs) at each size and channel count
+
+static void window_agc_task(void *_s, size_t channel, size_t worker) {
+    (void) worker;
+
+    bench_state_t *s = _s;
+    agc_process(&s->agc[channel], s->details[channel].samples, s->frames, 1);
+}
+
+static void window_fft_task(void *_s, size_t channel, size_t worker) {
+    bench_state_t *s = _s;
+    stft_transform(&s->stft, worker, s->details[channel].samples, s->details[channel].fft);
+    band_map_apply(&s->bands, s->details[channel].fft, s->details[channel].bands);
+}
+
+static void bench_window_serial(bench_state_t *s) {
+    for (size_t j = 0; j < s->channels; j++)
+        window_agc_task(s, j, 0);
+
+    for (size_t j = 0; j < s->channels; j++)
+        window_fft_task(s, j, 0);
+}
+
+static void bench_window_parallel(bench_state_t *s) {
+    pool_run(&pool, window_agc_task, s, s->channels);
+    pool_run(&pool, window_fft_task, s, s->channels);
+}
+
+static void bench_decimate(bench_state_t *s) {
+    decimate_min_max(s->details[0].samples, s->frames, s->min, s->max, MIN(s->frames, BENCH_COLUMNS));
+}
+
+static void bench_fill_vector(bench_state_t *s) {
+    fill_vector_from_samples(s->details[0].samples, s->frames, s->coords, 540, 0, 40, (float) BENCH_COLUMNS / s->frames);
+}
+
+typedef struct {
+    const char *name;
+    bench_fn fn;
+    // swept over channel counts, everything else works on one channel
+    bool per_channel;
+} bench_kernel_t;
+
+static const bench_kernel_t kernels[] = {
+    { "fft_recursive", bench_fft_recursive, false },
+    { "fft", bench_fft, false },
+    { "fft_samples_scalar", bench_fft_samples_scalar, false },
+    { "fft_samples", bench_fft_samples, false },
+    { "stft_transform", bench_stft_transform, false },
+    { "stft_split", bench_stft_split, true },
+    { "stft_split_f32p", bench_stft_split_f32p, true },
+    { "stft_split_s16", bench_stft_split_s16, true },
+    { "stft_split_s32", bench_stft_split_s32, true },
+    { "agc_process", bench_agc, true },
+    { "merge_channels", bench_merge_channels, true },
+    { "band_map_apply", bench_band_map, false },
+    { "window_serial", bench_window_serial, true },
+    { "window_parallel", bench_window_parallel, true },
+    { "decimate_min_max", bench_decimate, false },
+    { "fill_vector_from_samples", bench_fill_vector, false },
+};
+
+static const size_t channel_counts[] = { 1, 2, 4, 6, 8 };
+
+static int compare_doubles(const void *l, const void *r) {
+    double a = *(const double *) l;
+    double b = *(const double *) r;
+
+    return (a > b) - (a < b);
+}
+
+static double percentile(double *sorted, size_t n, double p) {
+    return sorted[(size_t) (p * (n - 1) + 0.5)];
+}
+
+// largest difference to the reference, negative if the kernel has none
+//  fft against fft_recursive, fft_samples_scalar against fft, fft_samples against fft_samples_scalar
+static float bench_error(const bench_kernel_t *kernel, bench_state_t *s) {
+    size_t n_bins = rfft_bins(s->rplan);
+    float err = 0;
+
+    if (kernel->fn == bench_fft) {
+        bench_fft_recursive(s);
+        bench_fft(s);
+        for (size_t i = 0; i < s->frames; i++) {
+            err = fmaxf(err, fabsf(s->complex_work[i].real - s->re[i]));
+            err = fmaxf(err, fabsf(s->complex_work[i].imag - s->im[i]));
+        }
+    } else if (kernel->fn == bench_fft_samples_scalar) {
+        bench_fft(s);
+        bench_fft_samples_scalar(s);
+        for (size_t i = 0; i < n_bins; i++) {
+            err = fmaxf(err, fabsf(s->real[i] - s->re[i]));
+            err = fmaxf(err, fabsf(s->imag[i] - s->im[i]));
+        }
+    } else if (kernel->fn == bench_fft_samples) {
+        float mag_scalar[n_bins];
+        bench_fft_samples_scalar(s);
+        memcpy(mag_scalar, s->mag, n_bins * sizeof(float));
+
+        bench_fft_samples(s);
+        for (size_t i = 0; i < n_bins; i++)
+            err = fmaxf(err, fabsf(s->mag[i] - mag_scalar[i]));
+    } else {
+        return -1;
+    }
+
+    return err;
+}
+
+static void bench_run(const bench_kernel_t *kernel, signal_t signal, size_t frames, size_t channels) {
+    bench_state_t s;
+    bench_state_init(&s, frames, channels, signal);
+
+    float err = bench_error(kernel, &s);
+
+    // warm up and find how many calls make up a batch
+    size_t reps = 1;
+    for (;;) {
+        double start = now_ns();
+        for (size_t i = 0; i < reps; i++)
+            kernel->fn(&s);
+
+        if (now_ns() - start >= BENCH_BATCH_NS)
+            break;
+
+        reps *= 2;
+    }
+
+    double batches[BENCH_BATCHES];
+    for (size_t b = 0; b < BENCH_BATCHES; b++) {
+        double start = now_ns();
+        for (size_t i = 0; i < reps; i++)
+            kernel->fn(&s);
+
+        batches[b] = (now_ns() - start) / reps;
+    }
+
+    qsort(batches, BENCH_BATCHES, sizeof(*batches), compare_doubles);
+
+    double p50 = percentile(batches, BENCH_BATCHES, 0.50);
+    double p90 = percentile(batches, BENCH_BATCHES, 0.90);
+    double p99 = percentile(batches, BENCH_BATCHES, 0.99);
+
+    printf("%s\t%s\t%zu\t%zu\t%.1f\t%.1f\t%.1f\t%.3f\t%.0f\t",
+            kernel->name, signal_names[signal], frames, channels,
+            p50, p90, p99, p50 / frames, frames * (NANOS_PER_SEC / p50));
+
+    if (err >= 0)
+        printf("%.2e\n", err);
+    else
+        printf("-\n");
+
+    fflush(stdout);
+
+    bench_state_free(&s);
+}
+
+int main(int argc, char **argv) {
+    const char *filter = argc > 1 ? argv[1] : NULL;
+
+    pool_init(&pool, MIN(MAX(sysconf(_SC_NPROCESSORS_ONLN) - 1, 0), 7));
+
+    // stdout stays pure tsv
+    fprintf(stderr, "fft kernels: %s\n", fft_detect_kernels()->name);
+    fprintf(stderr, "workers: %zu\n", pool.n_threads);
+
+    printf("kernel\tsignal\tframes\tchannels\tp50_ns\tp90_ns\tp99_ns\tns_per_frame\tframes_per_sec\tmax_err\n");
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(*kernels); k++) {
+        const bench_kernel_t *kernel = &kernels[k];
+        if (filter != NULL && strstr(kernel->name, filter) == NULL)
+            continue;
+
+        size_t n_channel_counts = kernel->per_channel ? sizeof(channel_counts) / sizeof(*channel_counts) : 1;
+
+        for (signal_t signal = SIGNAL_SINE; signal <= SIGNAL_SILENCE; signal++) {
+            for (size_t frames = 64; frames <= 16384; frames <<= 1) {
+                for (size_t c = 0; c < n_channel_counts; c++)
+                    bench_run(kernel, signal, frames, channel_counts[c]);
+            }
+        }
+    }
+
+    pool_free(&pool);
+
+    return 0;
+}
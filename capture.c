@@ -0,0 +1,281 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<inttypes.h>
+#include<string.h>
+#include<time.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<semaphore.h>
+#include<stdatomic.h>
+#include<sys/mman.h>
+
+#include "util.h"
+
+// capture files, every buffer on_process dequeued, as it arrived
+//  the file is the magic followed by records, each a capture_record_t and
+//  n_samples samples in the format PipeWire negotiated, padded to 4 bytes, all in host byte order,
+//  --record appends to it from the RT thread through a ring drained by a writer thread,
+//  --replay maps it and feeds the records through the analysis the same way the live stream would
+
+#define CAPTURE_MAGIC "PAVCAP02"
+#define CAPTURE_MAGIC_SIZE 8
+
+// or'd into capture_record_t.format
+#define CAPTURE_PLANAR 0x100
+
+// staging buffer between the ring and write(2)
+#define CAPTURE_WRITE_SIZE (64 * 1024)
+
+typedef struct {
+    // CLOCK_MONOTONIC when on_process got the buffer
+    uint64_t time_ns;
+    // counts every buffer, so gaps show what the recorder had to drop
+    uint32_t sequence;
+    uint32_t rate;
+    uint32_t n_channels;
+    uint32_t n_samples;
+    // a sample_format_t, with CAPTURE_PLANAR when the channels come one after the other
+    uint32_t format;
+} capture_record_t;
+
+// keeps every record, and with it any sample format, aligned in the mapping
+static size_t capture_padded(size_t payload) {
+    return (payload + 3) & ~(size_t) 3;
+}
+
+static int write_all(int fd, const void *src, size_t bytes) {
+    const uint8_t *p = src;
+
+    while (bytes > 0) {
+        ssize_t n = write(fd, p, bytes);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        p += n;
+        bytes -= n;
+    }
+
+    return 0;
+}
+
+// RT thread, never blocks, the buffer is dropped if the writer is behind
+//  planes is n_channels long for planar chunks and a single pointer otherwise
+void recorder_push(recorder_t *rec, audio_chunk_t *chunk, const void *const *planes) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // it goes into the file as is, an initializer leaves the padding at whatever was on the stack
+    capture_record_t record;
+    memset(&record, 0, sizeof(record));
+
+    record.time_ns = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    record.sequence = rec->sequence++;
+    record.rate = chunk->rate;
+    record.n_channels = chunk->n_channels;
+    record.n_samples = chunk->n_samples;
+    record.format = chunk->format | (chunk->planar ? CAPTURE_PLANAR : 0);
+
+    size_t n_planes = chunk->planar ? chunk->n_channels : 1;
+    size_t payload = chunk->n_samples * sample_size(chunk->format);
+    size_t plane_bytes = payload / n_planes;
+    size_t padded = capture_padded(payload);
+
+    if (spsc_ring_writable(&rec->ring) < sizeof(record) + padded) {
+        spsc_ring_overrun(&rec->ring);
+        return;
+    }
+
+    static const uint8_t zeros[4] = {0};
+
+    spsc_ring_put(&rec->ring, 0, &record, sizeof(record));
+    for (size_t i = 0; i < n_planes; i++)
+        spsc_ring_put(&rec->ring, sizeof(record) + i * plane_bytes, planes[i], plane_bytes);
+
+    spsc_ring_put(&rec->ring, sizeof(record) + payload, zeros, padded - payload);
+    spsc_ring_commit(&rec->ring, sizeof(record) + padded);
+
+    sem_post(&rec->wakeup);
+}
+
+// the file is just the records back to back, so the ring is written out as a byte stream
+static void recorder_drain(recorder_t *rec, uint8_t *staging) {
+    size_t readable;
+    while ((readable = spsc_ring_readable(&rec->ring)) > 0) {
+        size_t bytes = MIN(readable, CAPTURE_WRITE_SIZE);
+
+        spsc_ring_get(&rec->ring, 0, staging, bytes);
+        spsc_ring_consume(&rec->ring, bytes);
+
+        // keep draining after a failure so the RT thread isn't left with a full ring
+        if (!rec->failed && write_all(rec->fd, staging, bytes) < 0) {
+            fprintf(stderr, "record: write: %s, not recording any more\n", strerror(errno));
+            rec->failed = true;
+        }
+    }
+}
+
+void *recorder_thread_init(void *_rec) {
+    recorder_t *rec = _rec;
+
+    uint8_t *staging = malloc(CAPTURE_WRITE_SIZE);
+
+    while (true) {
+        sem_wait(&rec->wakeup);
+
+        // whatever was committed before quit was set still makes it to the file
+        bool quit = atomic_load(&rec->quit);
+        recorder_drain(rec, staging);
+
+        if (quit)
+            break;
+    }
+
+    free(staging);
+
+    return NULL;
+}
+
+int recorder_start(recorder_t *rec, const char *path, size_t ring_size) {
+    *rec = (recorder_t) {0};
+
+    rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (rec->fd < 0) {
+        fprintf(stderr, "record: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (write_all(rec->fd, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) < 0) {
+        fprintf(stderr, "record: %s: %s\n", path, strerror(errno));
+        close(rec->fd);
+        return -1;
+    }
+
+    spsc_ring_init(&rec->ring, ring_size);
+    sem_init(&rec->wakeup, 0, 0);
+    atomic_init(&rec->quit, false);
+
+    pthread_create(&rec->tid, NULL, recorder_thread_init, rec);
+
+    return 0;
+}
+
+// the stream has to be gone by now, nothing may push after this
+void recorder_stop(recorder_t *rec) {
+    atomic_store(&rec->quit, true);
+    sem_post(&rec->wakeup);
+
+    pthread_join(rec->tid, NULL);
+
+    fprintf(stderr, "record: %u buffers | dropped %" PRIu64 "\n", rec->sequence,
+            atomic_load_explicit(&rec->ring.overruns, memory_order_relaxed));
+
+    close(rec->fd);
+    sem_destroy(&rec->wakeup);
+    spsc_ring_free(&rec->ring);
+}
+
+static void sleep_until_ns(uint64_t deadline_ns) {
+    struct timespec deadline = {
+        .tv_sec = deadline_ns / 1000000000,
+        .tv_nsec = deadline_ns % 1000000000,
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
+
+// as fast as possible, or with the original spacing between buffers with --replay-realtime
+int run_replay(ctx_t *ctx) {
+    size_t size;
+    uint8_t *map = map_file(ctx->opts.replay, &size);
+    if (map == NULL)
+        return -1;
+
+    if (size < CAPTURE_MAGIC_SIZE || memcmp(map, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE)) {
+        fprintf(stderr, "replay: %s is not a capture file, see --record\n", ctx->opts.replay);
+        munmap(map, size);
+        return -1;
+    }
+
+    analysis_init(ctx);
+
+    size_t n_buffers = 0;
+    size_t n_skipped = 0;
+    size_t n_frames = 0;
+    uint64_t n_dropped = 0;
+    double audio_seconds = 0;
+
+    uint64_t first_ns = 0;
+    uint32_t next_sequence = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t start_ns = (uint64_t) start.tv_sec * 1000000000 + start.tv_nsec;
+
+    size_t offset = CAPTURE_MAGIC_SIZE;
+    while (offset + sizeof(capture_record_t) <= size) {
+        // records are only 4 byte aligned in the file
+        capture_record_t record;
+        memcpy(&record, map + offset, sizeof(record));
+
+        sample_format_t format = record.format & ~CAPTURE_PLANAR;
+        size_t payload = (size_t) record.n_samples * sample_size(format);
+        if (payload > size - offset - sizeof(record)) {
+            fprintf(stderr, "replay: truncated record at byte %zu, stopping\n", offset);
+            break;
+        }
+
+        const uint8_t *samples = map + offset + sizeof(record);
+        offset += sizeof(record) + capture_padded(payload);
+
+        if (n_buffers + n_skipped == 0)
+            first_ns = record.time_ns;
+        else
+            n_dropped += record.sequence - next_sequence;
+
+        next_sequence = record.sequence + 1;
+
+        // same checks as the analysis thread, buffers from before the format was known end up here
+        if (record.n_channels == 0 || record.n_channels > MAX_CHANNELS || record.n_samples < record.n_channels || record.rate == 0 || format > SAMPLE_S32) {
+            n_skipped++;
+            continue;
+        }
+
+        if (ctx->opts.replay_realtime)
+            sleep_until_ns(start_ns + (record.time_ns - first_ns));
+
+        audio_chunk_t chunk = {
+            .n_samples = record.n_samples,
+            .n_channels = record.n_channels,
+            .rate = record.rate,
+            .format = format,
+            .planar = record.format & CAPTURE_PLANAR,
+        };
+
+        int64_t analysis_start = metrics_now();
+
+        // analyze_chunk only reads the samples, the mapping is read only
+        analyze_chunk(ctx, &ctx->sources[0], &chunk, samples);
+
+        metrics_since_source(&ctx->metrics, 0, METRIC_ANALYSIS, analysis_start);
+
+        n_buffers++;
+        n_frames += record.n_samples / record.n_channels;
+        audio_seconds += (double) (record.n_samples / record.n_channels) / record.rate;
+    }
+
+    printf("replay: %s | %zu buffers | skipped %zu | dropped while recording %" PRIu64 "\n",
+            ctx->opts.replay, n_buffers, n_skipped, n_dropped);
+    offline_report(ctx, &start, n_frames, n_buffers, audio_seconds);
+
+    analysis_free(ctx);
+    munmap(map, size);
+
+    return 0;
+}
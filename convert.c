@@ -0,0 +1,82 @@
+#include<stdlib.h>
+#include<stdint.h>
+#include<stdbool.h>
+
+#include "dsp.h"
+
+// sample format conversion, straight from what PipeWire handed over into the stft history
+//  one call converts one channel, reading every stride'th sample, so the same kernels deinterleave
+//  interleaved buffers and copy planar ones, the strides seen in practice (1 for planar and mono,
+//  2 for stereo) get loops of their own, with the stride known gcc vectorises the loads
+
+const char *sample_format_names[] = {
+    [SAMPLE_F32] = "f32",
+    [SAMPLE_S16] = "s16",
+    [SAMPLE_S32] = "s32",
+};
+
+size_t sample_size(sample_format_t format) {
+    switch (format) {
+        case SAMPLE_S16:
+            return sizeof(int16_t);
+        case SAMPLE_S32:
+            return sizeof(int32_t);
+        case SAMPLE_F32:
+        default:
+            return sizeof(float);
+    }
+}
+
+static inline void convert_f32(float *restrict dst, const float *restrict src, size_t stride, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = src[i * stride];
+}
+
+static inline void convert_s16(float *restrict dst, const int16_t *restrict src, size_t stride, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = src[i * stride] * (1.0f / 32768);
+}
+
+static inline void convert_s32(float *restrict dst, const int32_t *restrict src, size_t stride, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = src[i * stride] * (1.0f / 2147483648.0f);
+}
+
+#define CONVERT_STRIDED(kernel, dst, src, stride, n) \
+    do { \
+        if ((stride) == 1) \
+            kernel(dst, src, 1, n); \
+        else if ((stride) == 2) \
+            kernel(dst, src, 2, n); \
+        else \
+            kernel(dst, src, stride, n); \
+    } while (0)
+
+// n floats into dst from every stride'th sample of src
+void convert_samples(float *dst, const void *src, sample_format_t format, size_t stride, size_t n) {
+    switch (format) {
+        case SAMPLE_S16:
+            CONVERT_STRIDED(convert_s16, dst, (const int16_t *) src, stride, n);
+            break;
+        case SAMPLE_S32:
+            CONVERT_STRIDED(convert_s32, dst, (const int32_t *) src, stride, n);
+            break;
+        case SAMPLE_F32:
+        default:
+            CONVERT_STRIDED(convert_f32, dst, (const float *) src, stride, n);
+            break;
+    }
+}
+
+// how a chunk of n_frames frames queued by on_process is laid out
+sample_view_t sample_view(const void *data, sample_format_t format, bool planar, size_t n_channels, size_t n_frames) {
+    sample_view_t view = {
+        .format = format,
+        .stride = planar ? 1 : n_channels,
+    };
+
+    for (size_t i = 0; i < MIN(n_channels, MAX_CHANNELS); i++)
+        view.channels[i] = (const uint8_t *) data + (planar ? i * n_frames : i) * sample_size(format);
+
+    return view;
+}
@@ -0,0 +1,224 @@
+#ifndef __PAV_DSP
+#define __PAV_DSP
+
+#include<time.h>
+#include<stddef.h>
+#include<stdint.h>
+#include<stdbool.h>
+#include<stdatomic.h>
+#include<pthread.h>
+#include<semaphore.h>
+
+// analysis types and helpers, doesn't pull in PipeWire or Raylib so bench.c can use it
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+
+#define NANOS_PER_SEC 1000000000
+
+// see arena.c
+typedef struct {
+    uint8_t *base;
+    size_t capacity;
+    size_t used;
+} arena_t;
+
+// streams with more channels are ignored, buffers are sized for what the stream negotiates
+#define MAX_CHANNELS 64
+
+typedef struct {
+    float *samples;
+    float *fft;
+    float *bands;
+} channel_details_t;
+
+// where a bit of audio sits on the PipeWire graph clock, see on_process
+typedef struct {
+    // CLOCK_MONOTONIC ns the newest sample was captured at, 0 when not known (files, replays)
+    int64_t capture_ns;
+
+    // straight from pw_stream_get_time_n, delay is in rate units
+    uint64_t ticks;
+    int64_t delay;
+    uint32_t rate_num;
+    uint32_t rate_denom;
+} stream_time_t;
+
+// one complete analysis result, see frames.c
+typedef struct {
+    size_t n_samples;
+    size_t n_channels;
+    size_t relevant_fft_bins;
+    size_t n_bands;
+    channel_details_t *details;
+
+    // of the newest sample in the window
+    stream_time_t time;
+
+    uint64_t sequence;
+
+    // backs details, see frame_resize
+    arena_t arena;
+} analysis_frame_t;
+
+// what PipeWire may hand over, converted to float only as the stft takes it, see convert.c
+typedef enum {
+    SAMPLE_F32,
+    SAMPLE_S16,
+    SAMPLE_S32,
+} sample_format_t;
+
+// where one chunk's samples are and how they're laid out, offsets are in samples
+typedef struct {
+    // each channel's first sample, they don't have to be evenly spaced, a chunk read in place may wrap around the ring
+    const void *channels[MAX_CHANNELS];
+    sample_format_t format;
+    // from one frame to the next within a channel, n_channels when interleaved, 1 when planar
+    size_t stride;
+} sample_view_t;
+
+// header of every chunk queued from on_process, followed by n_samples samples in format,
+//  interleaved or one channel after the other when planar, padded as chunk_ring_size says
+typedef struct {
+    uint32_t n_samples;
+    uint32_t n_channels;
+    uint32_t rate;
+    sample_format_t format;
+    bool planar;
+
+    // of the last frame in the chunk
+    stream_time_t time;
+    // CLOCK_MONOTONIC ns it went into the ring, for METRIC_QUEUE
+    int64_t queued_ns;
+} audio_chunk_t;
+
+// see ring.c
+typedef struct {
+    uint8_t *data;
+    size_t capacity;
+    size_t mask;
+
+    // written by the producer
+    _Atomic size_t head;
+    // written by the consumer
+    _Atomic size_t tail;
+
+    // stats, written by the producer, read by anyone
+    _Atomic uint64_t commits;
+    _Atomic uint64_t overruns;
+    _Atomic size_t high_water;
+} spsc_ring_t;
+
+// see agc.c
+typedef struct {
+    float target;
+    // one pole coefficients for a single hop
+    float attack;
+    float release;
+
+    float mean_square;
+    float gain;
+    // mean square of the last window before any gain, for silence detection
+    float level;
+} agc_t;
+
+// see bands.c
+typedef enum {
+    BAND_SCALE_LINEAR,
+    BAND_SCALE_LOG,
+    BAND_SCALE_OCTAVE,
+    BAND_SCALE_MEL,
+    BAND_SCALE_BARK,
+} band_scale_t;
+
+typedef struct {
+    uint32_t bin;
+    uint32_t band;
+    float weight;
+} band_entry_t;
+
+typedef struct {
+    band_scale_t scale;
+    size_t max_bands;
+    size_t fft_size;
+
+    // what the table was last built for
+    uint32_t rate;
+    size_t n_bins;
+    size_t n_bands;
+
+    band_entry_t *entries;
+    size_t n_entries;
+    size_t capacity;
+} band_map_t;
+
+// everything one stft_transform needs, one per thread running them
+typedef struct {
+    float *windowed;
+    float *real;
+    float *imag;
+    // for the half size complex fft
+    float *z_real;
+    float *z_imag;
+} stft_scratch_t;
+
+// see stft.c
+typedef struct {
+    size_t size;
+    size_t hop;
+    size_t n_channels;
+    uint32_t rate;
+
+    struct rfft_plan_s *plan;
+    float *window;
+
+    // backs the scratch, sized once
+    arena_t arena;
+    stft_scratch_t *scratch;
+    size_t n_scratch;
+
+    // n_channels rings of size frames each, cursor is the oldest frame,
+    //  in an arena of their own that stft_reset grows with the channel count
+    arena_t history_arena;
+    float *history;
+    size_t cursor;
+    // frames fed since the last window
+    size_t pending;
+} stft_t;
+
+// task, worker index, the caller of pool_run is worker 0
+typedef void (*pool_fn)(void *arg, size_t task, size_t worker);
+
+// see pool.c
+typedef struct {
+    pthread_t *threads;
+    size_t n_threads;
+
+    // caller -> helpers, once per helper per pool_run, and back
+    sem_t start;
+    sem_t done;
+
+    // the current pool_run, only written while the helpers are parked
+    pool_fn fn;
+    void *arg;
+    size_t n_tasks;
+    _Atomic size_t next;
+
+    atomic_bool quit;
+} pool_t;
+
+#define FRAME_BUFFER_SLOTS 3
+
+typedef struct {
+    analysis_frame_t slots[FRAME_BUFFER_SLOTS];
+
+    // owned by the audio thread
+    uint32_t write;
+    uint64_t published;
+    // owned by the render thread
+    uint32_t read;
+    // shared, slot index plus a "fresh" bit
+    _Atomic uint32_t middle;
+} frame_buffer_t;
+
+#endif // __PAV_DSP
@@ -0,0 +1,129 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<stdatomic.h>
+#include<sys/mman.h>
+
+#include "util.h"
+#include "pav_export.h"
+
+// writer side of --export-shm, the layout and the reader helpers are in pav_export.h
+//  the analysis thread is the only writer, every published frame of every source is copied into
+//  the next slot of that source's ring, never waiting on readers, nothing is exported while a source is idle
+
+// frames kept per source, a reader polling at 60Hz misses none at the default hop
+#define EXPORT_SLOTS 16
+
+static size_t export_align(size_t size) {
+    return (size + 63) & ~(size_t) 63;
+}
+
+// shm_open wants a single leading slash, --export-shm takes the name with or without it
+int exporter_start(exporter_t *ex, const char *name, size_t n_sources, size_t max_bands) {
+    *ex = (exporter_t) {0};
+
+    snprintf(ex->name, sizeof(ex->name), "%s%s", name[0] == '/' ? "" : "/", name);
+
+    size_t slot_size = export_align(sizeof(pav_export_frame_t) + PAV_EXPORT_MAX_CHANNELS * max_bands * sizeof(float));
+    size_t ring_size = PAV_EXPORT_SLOTS_OFFSET + EXPORT_SLOTS * slot_size;
+    size_t rings_offset = export_align(sizeof(pav_export_header_t));
+    size_t map_size = rings_offset + n_sources * ring_size;
+
+    int fd = shm_open(ex->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "export: %s: %s\n", ex->name, strerror(errno));
+        return -1;
+    }
+
+    // comes back zeroed, so every ring starts out empty
+    if (ftruncate(fd, map_size) < 0) {
+        fprintf(stderr, "export: %s: %s\n", ex->name, strerror(errno));
+        close(fd);
+        shm_unlink(ex->name);
+        return -1;
+    }
+
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "export: %s: mmap: %s\n", ex->name, strerror(errno));
+        shm_unlink(ex->name);
+        return -1;
+    }
+
+    ex->map = map;
+    ex->map_size = map_size;
+    ex->header = map;
+
+    *ex->header = (pav_export_header_t) {
+        .version = PAV_EXPORT_VERSION,
+        .n_sources = n_sources,
+        .n_slots = EXPORT_SLOTS,
+        .max_bands = max_bands,
+        .max_channels = PAV_EXPORT_MAX_CHANNELS,
+        .slot_size = slot_size,
+        .rings_offset = rings_offset,
+        .ring_size = ring_size,
+        .map_size = map_size,
+    };
+
+    // readers that open it this early only go by the magic
+    atomic_thread_fence(memory_order_release);
+    ex->header->magic = PAV_EXPORT_MAGIC;
+
+    printf("export: /dev/shm%s | sources: %zu | slots: %d | %zu bytes\n", ex->name, n_sources, EXPORT_SLOTS, map_size);
+
+    return 0;
+}
+
+// readers that still have it mapped keep their copy, new ones won't find it
+void exporter_stop(exporter_t *ex) {
+    if (ex->map == NULL)
+        return;
+
+    munmap(ex->map, ex->map_size);
+    shm_unlink(ex->name);
+    ex->map = NULL;
+}
+
+// analysis thread, right after the frame was published
+void exporter_push(exporter_t *ex, source_t *source, analysis_frame_t *frame) {
+    pav_export_header_t *header = ex->header;
+    uint8_t *ring_base = ex->map + header->rings_offset + source->index * header->ring_size;
+    pav_export_ring_t *ring = (pav_export_ring_t *) ring_base;
+
+    uint64_t written = atomic_load_explicit(&ring->written, memory_order_relaxed);
+    pav_export_frame_t *slot = (pav_export_frame_t *) (ring_base + PAV_EXPORT_SLOTS_OFFSET + (written % header->n_slots) * header->slot_size);
+
+    // odd before anything in the slot changes, see pav_export_read_end for the other half
+    uint32_t lock = atomic_load_explicit(&slot->lock, memory_order_relaxed);
+    atomic_store_explicit(&slot->lock, lock + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    size_t n_channels = MIN(frame->n_channels, PAV_EXPORT_MAX_CHANNELS);
+    size_t n_bands = MIN(frame->n_bands, header->max_bands);
+
+    slot->source = source->index;
+    slot->sequence = frame->sequence;
+    slot->capture_ns = frame->time.capture_ns;
+    slot->publish_ns = metrics_now();
+    slot->rate = source->stft.rate;
+    slot->n_channels = n_channels;
+    slot->stream_channels = frame->n_channels;
+    slot->n_bands = n_bands;
+
+    for (size_t c = 0; c < n_channels; c++) {
+        // the agc keeps the mean square of the window it just went over
+        slot->rms[c] = sqrtf(source->agc[c].level);
+        memcpy(slot->bands + c * header->max_bands, frame->details[c].bands, n_bands * sizeof(float));
+    }
+
+    atomic_store_explicit(&slot->lock, lock + 2, memory_order_release);
+    atomic_store_explicit(&ring->written, written + 1, memory_order_release);
+}
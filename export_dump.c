@@ -0,0 +1,114 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<inttypes.h>
+#include<time.h>
+#include<math.h>
+
+#include "pav_export.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+// example --export-shm reader, prints every frame of every source as it comes in
+//  only needs pav_export.h, reads the slots in place without copying them
+
+// characters per printed spectrum
+#define DUMP_WIDTH 48
+
+static int64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// first channel's bands squeezed into DUMP_WIDTH characters, false if the writer overwrote the slot meanwhile
+//  or already had before it was read, then it holds a later frame than index and the lock can't tell
+static bool dump_frame(const pav_export_t *ex, const pav_export_frame_t *frame, uint64_t index) {
+    static const char levels[] = " .:-=+*#%@";
+
+    uint32_t lock;
+    if (!pav_export_read_begin(frame, &lock))
+        return false;
+
+    uint32_t n_bands = frame->n_channels > 0 ? MIN(frame->n_bands, ex->header->max_bands) : 0;
+
+    float columns[DUMP_WIDTH] = {0};
+    float peak = 0;
+    for (size_t i = 0; i < DUMP_WIDTH; i++) {
+        size_t start = i * n_bands / DUMP_WIDTH;
+        size_t end = (i + 1) * n_bands / DUMP_WIDTH;
+
+        for (size_t j = start; j < end; j++)
+            columns[i] = fmaxf(columns[i], frame->bands[j]);
+
+        peak = fmaxf(peak, columns[i]);
+    }
+
+    // relative to the loudest column, the writer's gain control keeps the absolute level moving anyway
+    char line[DUMP_WIDTH + 1] = {0};
+    for (size_t i = 0; i < DUMP_WIDTH; i++)
+        line[i] = levels[(size_t) (peak > 0 ? columns[i] / peak * (sizeof(levels) - 2) : 0)];
+
+    uint32_t source = frame->source;
+    uint64_t sequence = frame->sequence;
+    int64_t publish_ns = frame->publish_ns;
+    float rms = frame->n_channels > 0 ? frame->rms[0] : 0;
+
+    if (!pav_export_read_end(frame, lock) || sequence != index + 1)
+        return false;
+
+    printf("%u %8" PRIu64 " %6.0fus %6.1fdB |%s|\n", source, sequence,
+            (now_ns() - publish_ns) / 1000.0, 20 * log10f(fmaxf(rms, 1e-9f)), line);
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <name given to --export-shm>\n", argv[0]);
+        return 1;
+    }
+
+    // the leading slash is optional, as for --export-shm
+    char name[256];
+    snprintf(name, sizeof(name), "%s%s", argv[1][0] == '/' ? "" : "/", argv[1]);
+
+    pav_export_t ex;
+    if (pav_export_open(&ex, name) < 0) {
+        fprintf(stderr, "%s: not there or not an export, is the visualizer running with --export-shm?\n", name);
+        return 1;
+    }
+
+    const pav_export_header_t *header = ex.header;
+    printf("%s | sources: %u | slots: %u | bands: %u\n", name, header->n_sources, header->n_slots, header->max_bands);
+
+    uint64_t *seen = calloc(header->n_sources, sizeof(*seen));
+    for (uint32_t s = 0; s < header->n_sources; s++)
+        seen[s] = pav_export_written(&ex, s);
+
+    while (true) {
+        for (uint32_t s = 0; s < header->n_sources; s++) {
+            uint64_t written = pav_export_written(&ex, s);
+
+            // more than a ring behind, the oldest ones are gone
+            if (written - seen[s] > header->n_slots) {
+                printf("%u missed %" PRIu64 " frames\n", s, written - seen[s] - header->n_slots);
+                seen[s] = written - header->n_slots;
+            }
+
+            for (; seen[s] < written; seen[s]++) {
+                if (!dump_frame(&ex, pav_export_slot(&ex, s, seen[s]), seen[s]))
+                    printf("%u missed frame %" PRIu64 ", overwritten\n", s, seen[s]);
+            }
+        }
+
+        struct timespec poll = { 0, 2000000 };
+        nanosleep(&poll, NULL);
+    }
+
+    free(seen);
+    pav_export_close(&ex);
+
+    return 0;
+}
@@ -6,6 +6,8 @@
 #include<string.h>
 #include<math.h>
 
+#include "fft_simd.c"
+
 typedef struct {
     float real;
     float imag;
@@ -43,7 +45,8 @@ complex_arr_t complex_arr_new(complex_t *items, size_t size) {
     };
 }
 
-void fft(complex_arr_t arr) {
+// reference implementation, kept around for bench.c
+void fft_recursive(complex_arr_t arr) {
     assert(__builtin_popcount(arr.size) == 1);
 
     size_t n = arr.size;
@@ -61,8 +64,8 @@ void fft(complex_arr_t arr) {
         odd_buf[i] = arr.items[i * 2 + 1];
     }
 
-    fft(complex_arr_new(even_buf, half));
-    fft(complex_arr_new(odd_buf, half));
+    fft_recursive(complex_arr_new(even_buf, half));
+    fft_recursive(complex_arr_new(odd_buf, half));
 
     float angle = 2 * M_PI / n;
     complex_t w = { .real = 1 };
@@ -80,18 +83,192 @@ void fft(complex_arr_t arr) {
     }
 }
 
-void fft_samples(float *samples, float *fft_out, float *fft_imag_out, size_t n_samples) {
-    complex_t buf[n_samples];
+// everything that only depends on the transform size, built once and reused
+//  data is kept in split real/imag (SoA) layout so the butterflies vectorise
+typedef struct fft_plan_s {
+    size_t size;
+    uint32_t *bit_reverse;
+    // per stage twiddles, stored contiguously so each block reads them linearly
+    //  the stage with half size h starts at h - 1 and holds w_2h^k for k in [0, h)
+    float *twiddles_real;
+    float *twiddles_imag;
+    float *scratch_real;
+    float *scratch_imag;
+    const fft_kernels_t *kernels;
+} fft_plan_t;
+
+static float *fft_alloc_floats(size_t n) {
+    // aligned_alloc wants a non-zero multiple of the alignment
+    size_t bytes = (n * sizeof(float) / 32 + 1) * 32;
+
+    return aligned_alloc(32, bytes);
+}
+
+fft_plan_t *fft_plan_new(size_t n) {
+    assert(__builtin_popcountl(n) == 1);
+
+    fft_plan_t *plan = malloc(sizeof(*plan));
+
+    plan->size = n;
+    plan->bit_reverse = malloc(n * sizeof(*plan->bit_reverse));
+    plan->twiddles_real = fft_alloc_floats(n);
+    plan->twiddles_imag = fft_alloc_floats(n);
+    plan->scratch_real = fft_alloc_floats(n);
+    plan->scratch_imag = fft_alloc_floats(n);
+    plan->kernels = fft_detect_kernels();
+
+    size_t bits = __builtin_ctzl(n);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t rev = 0;
+        for (size_t b = 0; b < bits; b++)
+            rev |= ((i >> b) & 1) << (bits - 1 - b);
+
+        plan->bit_reverse[i] = rev;
+    }
+
+    // computed in double precision, directly from the angle, no accumulated error
+    for (size_t half = 1; half < n; half <<= 1) {
+        for (size_t k = 0; k < half; k++) {
+            double angle = M_PI * k / half;
+            plan->twiddles_real[half - 1 + k] = cos(angle);
+            plan->twiddles_imag[half - 1 + k] = -sin(angle);
+        }
+    }
+
+    return plan;
+}
+
+void fft_plan_free(fft_plan_t *plan) {
+    if (plan == NULL)
+        return;
+
+    free(plan->bit_reverse);
+    free(plan->twiddles_real);
+    free(plan->twiddles_imag);
+    free(plan->scratch_real);
+    free(plan->scratch_imag);
+    free(plan);
+}
+
+// iterative in-place radix-2, both arrays hold plan->size elements
+void fft(fft_plan_t *plan, float *real, float *imag) {
+    size_t n = plan->size;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t j = plan->bit_reverse[i];
+        if (i < j) {
+            float tmp = real[i];
+            real[i] = real[j];
+            real[j] = tmp;
 
-    for (size_t i = 0; i < n_samples; i++)
-        buf[i] = (complex_t) { samples[i], 0 };
+            tmp = imag[i];
+            imag[i] = imag[j];
+            imag[j] = tmp;
+        }
+    }
 
-    complex_arr_t in = complex_arr_new(buf, n_samples);
+    for (size_t half = 1; half < n; half <<= 1) {
+        const float *w_re = plan->twiddles_real + half - 1;
+        const float *w_im = plan->twiddles_imag + half - 1;
 
-    fft(in);
+        // early stages are narrower than a vector
+        fft_butterfly_fn butterfly = half >= plan->kernels->width ? plan->kernels->butterfly : fft_kernels_scalar.butterfly;
 
-    for (size_t i = 0; i < in.size; i++) {
-        fft_out[i] = in.items[i].real;
-        fft_imag_out[i] = in.items[i].imag;
+        for (size_t start = 0; start < n; start += half * 2)
+            butterfly(real + start, imag + start, w_re, w_im, half);
     }
 }
+
+// real input transform, n real samples are packed into an n/2 complex fft
+//  and untangled into the n/2 + 1 non-redundant bins
+typedef struct rfft_plan_s {
+    size_t size;
+    fft_plan_t *half;
+    // w_n^k = e^(-2*pi*i*k/n) for k in [0, n/2)
+    float *twiddles_real;
+    float *twiddles_imag;
+} rfft_plan_t;
+
+rfft_plan_t *rfft_plan_new(size_t n) {
+    assert(__builtin_popcountl(n) == 1 && n >= 2);
+
+    rfft_plan_t *plan = malloc(sizeof(*plan));
+
+    plan->size = n;
+    plan->half = fft_plan_new(n / 2);
+    plan->twiddles_real = fft_alloc_floats(n / 2);
+    plan->twiddles_imag = fft_alloc_floats(n / 2);
+
+    for (size_t k = 0; k < n / 2; k++) {
+        double angle = 2 * M_PI * k / n;
+        plan->twiddles_real[k] = cos(angle);
+        plan->twiddles_imag[k] = -sin(angle);
+    }
+
+    return plan;
+}
+
+void rfft_plan_free(rfft_plan_t *plan) {
+    if (plan == NULL)
+        return;
+
+    fft_plan_free(plan->half);
+    free(plan->twiddles_real);
+    free(plan->twiddles_imag);
+    free(plan);
+}
+
+// mostly for bench.c, to compare kernels against each other
+void rfft_plan_set_kernels(rfft_plan_t *plan, const fft_kernels_t *kernels) {
+    plan->half->kernels = kernels;
+}
+
+size_t rfft_bins(rfft_plan_t *plan) {
+    return plan->size / 2 + 1;
+}
+
+// same as fft_samples, with the caller's plan->size / 2 floats of scratch in z_re and z_im,
+//  so one plan can be used by several threads at once
+void fft_samples_scratch(rfft_plan_t *plan, float *samples, float *fft_out, float *fft_imag_out, float *z_re, float *z_im) {
+    size_t half = plan->size / 2;
+
+    for (size_t i = 0; i < half; i++) {
+        z_re[i] = samples[i * 2];
+        z_im[i] = samples[i * 2 + 1];
+    }
+
+    fft(plan->half, z_re, z_im);
+
+    // z[0] holds the sums of the even and odd halves
+    fft_out[0] = z_re[0] + z_im[0];
+    fft_imag_out[0] = 0;
+    fft_out[half] = z_re[0] - z_im[0];
+    fft_imag_out[half] = 0;
+
+    for (size_t k = 1; k < half; k++) {
+        // a = z[k], b = conj(z[half - k])
+        float a_re = z_re[k], a_im = z_im[k];
+        float b_re = z_re[half - k], b_im = -z_im[half - k];
+
+        // even = (a + b) / 2, odd = -i * (a - b) / 2
+        float even_re = (a_re + b_re) * 0.5f;
+        float even_im = (a_im + b_im) * 0.5f;
+        float odd_re = (a_im - b_im) * 0.5f;
+        float odd_im = -(a_re - b_re) * 0.5f;
+
+        float w_re = plan->twiddles_real[k];
+        float w_im = plan->twiddles_imag[k];
+
+        fft_out[k] = even_re + (w_re * odd_re - w_im * odd_im);
+        fft_imag_out[k] = even_im + (w_re * odd_im + w_im * odd_re);
+    }
+}
+
+// writes rfft_bins(plan) values to both fft_out and fft_imag_out
+void fft_samples(rfft_plan_t *plan, float *samples, float *fft_out, float *fft_imag_out) {
+    fft_samples_scratch(plan, samples, fft_out, fft_imag_out, plan->half->scratch_real, plan->half->scratch_imag);
+}
+
+void fft_magnitudes(rfft_plan_t *plan, float *real, float *imag, float *dst, size_t n) {
+    plan->half->kernels->magnitude(real, imag, dst, n);
+}
@@ -0,0 +1,149 @@
+#include<stddef.h>
+#include<math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include<immintrin.h>
+#define FFT_X86 1
+#endif
+
+// butterflies for one block of a radix-2 stage in split real/imag layout,
+//  e = [0, half), o = [half, 2 * half), w = stage twiddles for [0, half)
+typedef void (*fft_butterfly_fn)(float *re, float *im, const float *w_re, const float *w_im, size_t half);
+typedef void (*fft_magnitude_fn)(const float *re, const float *im, float *dst, size_t n);
+
+typedef struct {
+    const char *name;
+    // elements per vector, blocks smaller than this go through the scalar kernel
+    size_t width;
+    fft_butterfly_fn butterfly;
+    fft_magnitude_fn magnitude;
+} fft_kernels_t;
+
+static void butterfly_scalar(float *re, float *im, const float *w_re, const float *w_im, size_t half) {
+    for (size_t i = 0; i < half; i++) {
+        float o_re = re[i + half];
+        float o_im = im[i + half];
+
+        float m_re = w_re[i] * o_re - w_im[i] * o_im;
+        float m_im = w_re[i] * o_im + w_im[i] * o_re;
+
+        re[i + half] = re[i] - m_re;
+        im[i + half] = im[i] - m_im;
+        re[i] = re[i] + m_re;
+        im[i] = im[i] + m_im;
+    }
+}
+
+static void magnitude_scalar(const float *re, const float *im, float *dst, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = sqrtf(re[i] * re[i] + im[i] * im[i]);
+}
+
+static const fft_kernels_t fft_kernels_scalar = {
+    .name = "scalar",
+    .width = 1,
+    .butterfly = butterfly_scalar,
+    .magnitude = magnitude_scalar,
+};
+
+#ifdef FFT_X86
+
+// same operation order as the scalar kernels, no fma, so results match bit for bit
+
+__attribute__((target("sse2")))
+static void butterfly_sse2(float *re, float *im, const float *w_re, const float *w_im, size_t half) {
+    for (size_t i = 0; i < half; i += 4) {
+        __m128 w_r = _mm_loadu_ps(w_re + i);
+        __m128 w_i = _mm_loadu_ps(w_im + i);
+        __m128 e_re = _mm_loadu_ps(re + i);
+        __m128 e_im = _mm_loadu_ps(im + i);
+        __m128 o_re = _mm_loadu_ps(re + i + half);
+        __m128 o_im = _mm_loadu_ps(im + i + half);
+
+        __m128 m_re = _mm_sub_ps(_mm_mul_ps(w_r, o_re), _mm_mul_ps(w_i, o_im));
+        __m128 m_im = _mm_add_ps(_mm_mul_ps(w_r, o_im), _mm_mul_ps(w_i, o_re));
+
+        _mm_storeu_ps(re + i + half, _mm_sub_ps(e_re, m_re));
+        _mm_storeu_ps(im + i + half, _mm_sub_ps(e_im, m_im));
+        _mm_storeu_ps(re + i, _mm_add_ps(e_re, m_re));
+        _mm_storeu_ps(im + i, _mm_add_ps(e_im, m_im));
+    }
+}
+
+__attribute__((target("sse2")))
+static void magnitude_sse2(const float *re, const float *im, float *dst, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 r = _mm_loadu_ps(re + i);
+        __m128 m = _mm_loadu_ps(im + i);
+
+        __m128 sum = _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m));
+        _mm_storeu_ps(dst + i, _mm_sqrt_ps(sum));
+    }
+
+    magnitude_scalar(re + i, im + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void butterfly_avx2(float *re, float *im, const float *w_re, const float *w_im, size_t half) {
+    for (size_t i = 0; i < half; i += 8) {
+        __m256 w_r = _mm256_loadu_ps(w_re + i);
+        __m256 w_i = _mm256_loadu_ps(w_im + i);
+        __m256 e_re = _mm256_loadu_ps(re + i);
+        __m256 e_im = _mm256_loadu_ps(im + i);
+        __m256 o_re = _mm256_loadu_ps(re + i + half);
+        __m256 o_im = _mm256_loadu_ps(im + i + half);
+
+        __m256 m_re = _mm256_sub_ps(_mm256_mul_ps(w_r, o_re), _mm256_mul_ps(w_i, o_im));
+        __m256 m_im = _mm256_add_ps(_mm256_mul_ps(w_r, o_im), _mm256_mul_ps(w_i, o_re));
+
+        _mm256_storeu_ps(re + i + half, _mm256_sub_ps(e_re, m_re));
+        _mm256_storeu_ps(im + i + half, _mm256_sub_ps(e_im, m_im));
+        _mm256_storeu_ps(re + i, _mm256_add_ps(e_re, m_re));
+        _mm256_storeu_ps(im + i, _mm256_add_ps(e_im, m_im));
+    }
+}
+
+__attribute__((target("avx2")))
+static void magnitude_avx2(const float *re, const float *im, float *dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 r = _mm256_loadu_ps(re + i);
+        __m256 m = _mm256_loadu_ps(im + i);
+
+        __m256 sum = _mm256_add_ps(_mm256_mul_ps(r, r), _mm256_mul_ps(m, m));
+        _mm256_storeu_ps(dst + i, _mm256_sqrt_ps(sum));
+    }
+
+    magnitude_scalar(re + i, im + i, dst + i, n - i);
+}
+
+static const fft_kernels_t fft_kernels_sse2 = {
+    .name = "sse2",
+    .width = 4,
+    .butterfly = butterfly_sse2,
+    .magnitude = magnitude_sse2,
+};
+
+static const fft_kernels_t fft_kernels_avx2 = {
+    .name = "avx2",
+    .width = 8,
+    .butterfly = butterfly_avx2,
+    .magnitude = magnitude_avx2,
+};
+
+#endif // FFT_X86
+
+const fft_kernels_t *fft_detect_kernels(void) {
+#ifdef FFT_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return &fft_kernels_avx2;
+
+    if (__builtin_cpu_supports("sse2"))
+        return &fft_kernels_sse2;
+#endif
+
+    return &fft_kernels_scalar;
+}
@@ -0,0 +1,86 @@
+#include<stdlib.h>
+#include<stdint.h>
+#include<stdatomic.h>
+#include<assert.h>
+
+#include "dsp.h"
+
+// lock-free triple buffer of analysis frames
+//  the audio thread owns one slot, the renderer owns another, and the third is
+//  handed back and forth with a single atomic exchange, neither side ever waits
+//  and a slot is only ever resized by whoever owns it
+
+#define FRAME_BUFFER_FRESH 0x4
+#define FRAME_BUFFER_INDEX 0x3
+
+// re-slices the frame's arena, only calls the allocator when the layout needs more than it ever did,
+//  that's the producer's back slot, so the renderer never sees the arena change
+void frame_resize(analysis_frame_t *frame, size_t n_samples, size_t n_bands, size_t n_channels) {
+    assert(n_channels <= MAX_CHANNELS);
+
+    if (frame->details != NULL && frame->n_samples == n_samples && frame->n_bands == n_bands && frame->n_channels == n_channels)
+        return;
+
+    // the fft only ever fills rfft_bins of an n_samples window
+    size_t n_bins = n_samples / 2 + 1;
+    size_t bytes = n_channels * (sizeof(channel_details_t) + (n_samples + n_bins + n_bands) * sizeof(float));
+    size_t capacity = arena_size_for(bytes, 1 + n_channels * 3);
+
+    if (capacity > frame->arena.capacity) {
+        arena_free(&frame->arena);
+        arena_init(&frame->arena, capacity);
+    }
+
+    arena_reset(&frame->arena);
+
+    frame->details = arena_alloc(&frame->arena, n_channels * sizeof(*frame->details));
+
+    for (size_t i = 0; i < n_channels; i++) {
+        frame->details[i].samples = arena_alloc(&frame->arena, n_samples * sizeof(float));
+        frame->details[i].fft = arena_alloc(&frame->arena, n_bins * sizeof(float));
+        frame->details[i].bands = arena_alloc(&frame->arena, n_bands * sizeof(float));
+    }
+
+    frame->n_samples = n_samples;
+    frame->n_bands = n_bands;
+    frame->n_channels = n_channels;
+}
+
+// the slots' arenas are sized by frame_resize for the layout the stream negotiates
+void frame_buffer_init(frame_buffer_t *fb) {
+    *fb = (frame_buffer_t) {
+        .write = 0,
+        .read = 1,
+        .middle = 2,
+    };
+}
+
+void frame_buffer_free(frame_buffer_t *fb) {
+    for (size_t i = 0; i < FRAME_BUFFER_SLOTS; i++) {
+        arena_free(&fb->slots[i].arena);
+        fb->slots[i].details = NULL;
+    }
+}
+
+// producer side, the returned frame is private until frame_buffer_publish
+analysis_frame_t *frame_buffer_back(frame_buffer_t *fb) {
+    return &fb->slots[fb->write];
+}
+
+void frame_buffer_publish(frame_buffer_t *fb) {
+    fb->slots[fb->write].sequence = ++fb->published;
+
+    uint32_t prev = atomic_exchange_explicit(&fb->middle, fb->write | FRAME_BUFFER_FRESH, memory_order_acq_rel);
+    fb->write = prev & FRAME_BUFFER_INDEX;
+}
+
+// consumer side, returns the newest complete frame, which stays valid
+//  and untouched until the next call
+analysis_frame_t *frame_buffer_read(frame_buffer_t *fb) {
+    if (atomic_load_explicit(&fb->middle, memory_order_relaxed) & FRAME_BUFFER_FRESH) {
+        uint32_t prev = atomic_exchange_explicit(&fb->middle, fb->read, memory_order_acq_rel);
+        fb->read = prev & FRAME_BUFFER_INDEX;
+    }
+
+    return &fb->slots[fb->read];
+}
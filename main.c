@@ -6,173 +6,193 @@
 #include<math.h>
 #include<raylib.h>
 #include<pthread.h>
+#include<unistd.h>
 
 #include "util.h"
 #include "fft.c"
+#include "arena.c"
+#include "frames.c"
+#include "convert.c"
+#include "ring.c"
+#include "stft.c"
+#include "agc.c"
+#include "bands.c"
+#include "reduce.c"
+#include "pool.c"
+#include "metrics.c"
+#include "export.c"
+#include "analysis.c"
+#include "offline.c"
+#include "capture.c"
 #include "pipewire_enumerate.c"
 #include "ui.c"
 
-// very crude normalization
-void normalize_samples(float *samples, size_t n_samples) {
-    const double RMS_TARGET = 1.2;
-    const int TOTAL_BUF_SIZE = 1024;
+void on_state_changed(void *_source, enum pw_stream_state old, enum pw_stream_state new, const char *error) {
+    source_t *source = _source;
 
-    static struct { double total; size_t cnt; } total_buffer[1024];
-    static size_t cursor = 0;
-
-    total_buffer[cursor].total = 0;
-    total_buffer[cursor].cnt = n_samples;
-    for (size_t i = 0; i < n_samples; i++) {
-        total_buffer[cursor].total += samples[i] * samples[i];
-    }
-
-    cursor = (cursor + 1) & (TOTAL_BUF_SIZE - 1);
-
-    double total = 0;
-    size_t cnt = 0;
-
-    for (size_t i = 0; i < TOTAL_BUF_SIZE; i++) {
-        total += total_buffer[i].total;
-        cnt += total_buffer[i].cnt;
-    }
-
-    double avg = sqrt(total / cnt);
-    double gain = RMS_TARGET / avg;
-
-    for (size_t i = 0; i < n_samples; i++) {
-        samples[i] = samples[i] * gain;
-    }
-}
-
-void process_samples(ctx_t *ctx) {
-    for (size_t i = 0; i < ctx->n_channels; i++) {
-        for (size_t j = 0; j < ctx->n_samples; j++) {
-            ctx->details[i].samples[j] *= ctx->opts.sample_boost;
-        }
-
-        normalize_samples(ctx->details[i].samples, ctx->n_samples);
-    }
-}
-
-void split_sample_channels(float *samples, channel_details_t *dst, size_t n_samples, size_t n_channels) {
-    size_t dst_size = n_samples / n_channels;
+    if (error)
+        printf("source %zu: state changed: error: %s\n", source->index, error);
 
-    for (size_t i = 0; i < dst_size; i++) {
-        for (size_t j = 0; j < n_channels; j++) {
-            dst[j].samples[i] = samples[i * n_channels + j];
-        }
-    }
+    printf("source %zu: state changed: old: %s\n", source->index, pw_stream_state_as_string(old));
+    printf("source %zu: state changed: new: %s\n", source->index, pw_stream_state_as_string(new));
 }
 
-void process_fft(ctx_t *ctx) {
-    for (size_t i = 0; i < ctx->n_channels; i++) {
-        float real[ctx->n_samples];
-        float imag[ctx->n_samples];
-
-        fft_samples(ctx->details[i].samples, real, imag, ctx->n_samples);
+// every format offered in EnumFormat, so PipeWire can hand over what the node produces without converting
+static const enum spa_audio_format offered_formats[] = {
+    SPA_AUDIO_FORMAT_F32,
+    SPA_AUDIO_FORMAT_F32P,
+    SPA_AUDIO_FORMAT_S32,
+    SPA_AUDIO_FORMAT_S32P,
+    SPA_AUDIO_FORMAT_S16,
+    SPA_AUDIO_FORMAT_S16P,
+};
 
-        for (size_t j = 0; j < ctx->n_samples; j++) {
-            ctx->details[i].fft[j] = sqrt(real[j] * real[j] + imag[j] * imag[j]);
-        }
+#define N_OFFERED_FORMATS (sizeof(offered_formats) / sizeof(*offered_formats))
+
+// -1 for anything that wasn't offered
+int sample_format_from_spa(enum spa_audio_format format, sample_format_t *dst, bool *planar) {
+    switch (format) {
+        case SPA_AUDIO_FORMAT_F32:
+        case SPA_AUDIO_FORMAT_F32P:
+            *dst = SAMPLE_F32;
+            break;
+        case SPA_AUDIO_FORMAT_S32:
+        case SPA_AUDIO_FORMAT_S32P:
+            *dst = SAMPLE_S32;
+            break;
+        case SPA_AUDIO_FORMAT_S16:
+        case SPA_AUDIO_FORMAT_S16P:
+            *dst = SAMPLE_S16;
+            break;
+        default:
+            return -1;
     }
-}
 
-void on_state_changed(void *_ctx, enum pw_stream_state old, enum pw_stream_state new, const char *error) {
-    (void) _ctx;
-
-    if (error)
-        printf("state changed: error: %s\n", error);
+    *planar = format == SPA_AUDIO_FORMAT_F32P || format == SPA_AUDIO_FORMAT_S32P || format == SPA_AUDIO_FORMAT_S16P;
 
-    printf("state changed: old: %s\n", pw_stream_state_as_string(old));
-    printf("state changed: new: %s\n", pw_stream_state_as_string(new));
+    return 0;
 }
 
-void on_param_changed(void *_ctx, uint32_t id, const struct spa_pod *param) {
-    ctx_t *ctx = _ctx;
+void on_param_changed(void *_source, uint32_t id, const struct spa_pod *param) {
+    source_t *source = _source;
 
     if (param == NULL || id != SPA_PARAM_Format)
         return;
 
-    if (spa_format_parse(param, &ctx->format.media_type, &ctx->format.media_subtype) < 0)
+    if (spa_format_parse(param, &source->format.media_type, &source->format.media_subtype) < 0)
         return;
 
-    if (ctx->format.media_type != SPA_MEDIA_TYPE_audio || ctx->format.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+    if (source->format.media_type != SPA_MEDIA_TYPE_audio || source->format.media_subtype != SPA_MEDIA_SUBTYPE_raw)
         return;
 
-    spa_format_audio_raw_parse(param, &ctx->format.info.raw);
-
-    printf("capturing rate: %d | channels: %d\n", ctx->format.info.raw.rate, ctx->format.info.raw.channels);
-}
-
-// TODO: arenas
-void realloc_buffers(ctx_t *ctx, uint32_t n_samples, uint32_t n_channels) {
-    if (ctx->details != NULL) {
-        for (size_t i = 0; i < ctx->n_channels; i++) {
-            assert(ctx->details[i].samples != NULL);
-            assert(ctx->details[i].fft != NULL);
-
-            free(ctx->details[i].samples);
-            free(ctx->details[i].fft);
-        }
+    spa_format_audio_raw_parse(param, &source->format.info.raw);
 
-        free(ctx->details);
+    // written here, read by on_process, both run on the loop thread one after the other
+    source->format_ok = sample_format_from_spa(source->format.info.raw.format, &source->sample_format, &source->planar) == 0;
+    if (!source->format_ok || source->format.info.raw.channels > MAX_CHANNELS) {
+        fprintf(stderr, "source %zu: unusable format %d with %d channels, ignoring it\n",
+                source->index, source->format.info.raw.format, source->format.info.raw.channels);
+        source->format_ok = false;
+        return;
     }
 
-    ctx->details = malloc(n_channels * sizeof(*ctx->details));
+    printf("source %zu: capturing rate: %d | channels: %d | %s%s\n", source->index,
+            source->format.info.raw.rate, source->format.info.raw.channels,
+            sample_format_names[source->sample_format], source->planar ? " planar" : "");
+}
 
-    for (size_t i = 0; i < n_channels; i++) {
-        ctx->details[i].samples = calloc(n_samples, sizeof(float));
-        ctx->details[i].fft = calloc(n_samples, sizeof(float));
-    }
+// now is when this graph cycle started on CLOCK_MONOTONIC, for a capture stream
+//  delay is how long ago the samples handed to us were captured
+stream_time_t stream_time(struct pw_stream *stream) {
+    struct pw_time time;
+    if (pw_stream_get_time_n(stream, &time, sizeof(time)) < 0 || time.now == 0 || time.rate.denom == 0)
+        return (stream_time_t) {0};
+
+    int64_t delay_ns = time.delay * (int64_t) time.rate.num * NANOS_PER_SEC / time.rate.denom;
+
+    return (stream_time_t) {
+        .capture_ns = time.now - delay_ns,
+        .ticks = time.ticks,
+        .delay = time.delay,
+        .rate_num = time.rate.num,
+        .rate_denom = time.rate.denom,
+    };
 }
 
-void on_process(void *_ctx) {
-    ctx_t *ctx = _ctx;
+// RT thread, nothing in here may block, timings go to lock-free metrics, see metrics.c
+//  every source has its own ring, so streams being processed in parallel never share a producer
+void on_process(void *_source) {
+    source_t *source = _source;
+    ctx_t *ctx = source->ctx;
+
+    int64_t start = metrics_now();
+    if (source->_last_audio_buffer != 0)
+        metrics_record_source(&ctx->metrics, source->index, METRIC_CYCLE, start - source->_last_audio_buffer);
+
+    source->_last_audio_buffer = start;
 
     struct pw_buffer *b;
-    if ((b = pw_stream_dequeue_buffer(ctx->stream)) == NULL) {
+    if ((b = pw_stream_dequeue_buffer(source->stream)) == NULL) {
         pw_log_warn("out of buffers: %m");
         return;
     }
 
     struct spa_buffer *buf = b->buffer;
 
-    float *samples;
-    if ((samples = buf->datas[0].data) == NULL)
-        return;
+    uint32_t n_channels = source->format.info.raw.channels;
+    uint32_t n_planes = source->planar ? n_channels : 1;
 
-    struct timespec audio_start;
-    clock_gettime(CLOCK_REALTIME, &audio_start);
-    uint32_t n_samples = buf->datas[0].chunk->size / sizeof(float);
-    uint32_t n_channels = ctx->format.info.raw.channels;
+    // whole frames only, planar formats have one data per channel, all with the same chunk size
+    size_t bytes = sample_size(source->sample_format);
+    size_t frame_bytes = bytes * (source->planar ? 1 : n_channels);
+    size_t plane_bytes = frame_bytes > 0 && buf->n_datas > 0 ? buf->datas[0].chunk->size / frame_bytes * frame_bytes : 0;
 
-    if (ctx->n_total_samples != n_samples || ctx->n_channels != n_channels) {
-        realloc_buffers(ctx, n_samples, n_channels);
-        printf("samples: %d | channels: %d | samples_per_channel: %d\n", n_samples, n_channels, n_samples / n_channels);
+    const void *planes[MAX_CHANNELS];
+    bool usable = source->format_ok && plane_bytes > 0 && buf->n_datas >= n_planes;
+    for (uint32_t i = 0; usable && i < n_planes; i++) {
+        struct spa_data *d = &buf->datas[i];
+        usable = d->data != NULL && d->chunk->offset + plane_bytes <= d->maxsize;
+
+        if (usable)
+            planes[i] = (const uint8_t *) d->data + d->chunk->offset;
     }
 
-    ctx->n_total_samples = n_samples;
-    ctx->n_samples = n_samples / n_channels;
-    ctx->n_channels = n_channels;
-    ctx->relevant_fft_bins = (size_t) (20000.0 / ((double) ctx->format.info.raw.rate / ctx->n_samples));
+    if (!usable) {
+        pw_stream_queue_buffer(source->stream, b);
+        return;
+    }
 
-    split_sample_channels(samples, ctx->details, ctx->n_total_samples, ctx->n_channels);
+    // the samples are copied out as they are, one memcpy per plane, the analysis thread converts them
+    audio_chunk_t chunk = {
+        .n_samples = plane_bytes * n_planes / bytes,
+        .n_channels = n_channels,
+        .rate = source->format.info.raw.rate,
+        .format = source->sample_format,
+        .planar = source->planar,
+        .time = stream_time(source->stream),
+        .queued_ns = start,
+    };
 
-    process_samples(ctx);
-    process_fft(ctx);
+    if (ctx->opts.record != NULL && source->index == 0)
+        recorder_push(&ctx->recorder, &chunk, planes);
 
-    pw_stream_queue_buffer(ctx->stream, b);
+    size_t payload = plane_bytes * n_planes;
+    if (spsc_ring_writable(&source->ring) >= chunk_ring_size(payload)) {
+        spsc_ring_put(&source->ring, 0, &chunk, sizeof(chunk));
+        for (uint32_t i = 0; i < n_planes; i++)
+            spsc_ring_put(&source->ring, sizeof(chunk) + i * plane_bytes, planes[i], plane_bytes);
 
-    struct timespec audio_end;
-    clock_gettime(CLOCK_REALTIME, &audio_end);
+        // the padding is never read, only skipped
+        spsc_ring_commit(&source->ring, chunk_ring_size(payload));
 
-    if (ctx->opts.log_timings) {
-        float diff_ns = timespec_diff_ns(&audio_start, &audio_end);
-        float last_diff_ms = timespec_diff_ns(&ctx->_last_audio_buffer, &audio_start) / 1000000;
-        fprintf(stderr, "audio sample cycle took %.2fns (%d/sec) (last was %.2fms ago)\n", diff_ns, (int) (NANOS_PER_SEC / diff_ns), last_diff_ms);
+        sem_post(&ctx->analysis_wakeup);
+    } else {
+        spsc_ring_overrun(&source->ring);
     }
 
-    ctx->_last_audio_buffer = audio_end;
+    pw_stream_queue_buffer(source->stream, b);
+
+    metrics_since_source(&ctx->metrics, source->index, METRIC_PROCESS, start);
 }
 
 struct pw_stream_events stream_events = {
@@ -196,12 +216,39 @@ void print_help(char *argv0) {
     printf("    --width/-w\n    \tint, default is monitor width\n");
     printf("    --height/-h\n    \tint, default is monitor height\n");
     printf("    --unlimited-fps\n    \ttoggle, don't limit FPS to monitor refresh rate\n");
-    printf("    --log-timings\n    \ttoggle, spam stderr with render and processing timings\n");
+    printf("    --log-timings\n    \ttoggle, print per stage timings and ring usage to stderr every --metrics-interval\n");
+    printf("    --metrics\n    \tpath, rewrite a tab separated file with per stage timings every --metrics-interval\n");
+    printf("    --metrics-interval\n    \tint, ms between timing reports, default 1000\n");
     printf("    --flip-colors\n    \ttoggle, flips colors\n");
+    printf("    --palette\n    \tcomma separated rrggbb or rrggbbaa colours, evenly spaced stops of a gradient replacing the red to blue one, up to 16\n");
+    printf("    --palette-alt\n    \tsame as --palette, for the green to blue one the second channel uses\n");
     printf("    --split-waves\n    \ttoggle, in --two-channels mode, split the 2 channels visually\n");
     printf("    --mirror\n    \ttoggle, mirror the frequency display vertically\n");
     printf("    --two-channels\n    \ttoggle, display 2 channels, will exit if there are not exactly 2 channels present, incompatible with --mirror\n");
-    printf("    --pw-source/-s\n    \tint, PipeWire node for source audio from, see --pw-list-nodes\n");
+    printf("    --spectrogram\n    \ttoggle, show a scrolling spectrogram of the last --history frames instead of the bars, incompatible with --mirror, --two-channels and --all-channels\n");
+    printf("    --history\n    \tint, frames the --spectrogram keeps on screen, default 512\n");
+    printf("    --all-channels\n    \ttoggle, display every channel's spectrum in a strip of its own, incompatible with --mirror and --two-channels\n");
+    printf("    --renderer\n    \timmediate or shader, immediate draws every bar and waveform column as a rectangle, shader draws each panel with a single quad and a fragment shader, default immediate\n");
+    printf("    --ring-size\n    \tint, KiB of audio buffered between the PipeWire thread and the analysis thread, rounded up to a power of 2, clamped to %d-%d, default 1024\n", RING_MIN_KIB, RING_MAX_KIB);
+    printf("    --fft-size\n    \tint, samples per analysis window, rounded up to a power of 2, default 2048\n");
+    printf("    --hop\n    \tint, samples between analysis windows, at most --fft-size, default 512\n");
+    printf("    --agc-target\n    \tfloat, RMS level the automatic gain control aims for, default 1.2\n");
+    printf("    --agc-attack\n    \tfloat, ms for the gain control to react to the signal getting louder, default 300\n");
+    printf("    --agc-release\n    \tfloat, ms for the gain control to react to the signal getting quieter, default 3000\n");
+    printf("    --scale\n    \tlinear, log, octave, mel or bark, frequency scale of the spectrum, default log\n");
+    printf("    --bands\n    \tint, number of spectrum bars, octave may use fewer, default 256\n");
+    printf("    --idle-fps\n    \tint, how often the window checks for input and track changes while no audio is coming in, default 5\n");
+    printf("    --workers\n    \tint, extra threads the per channel analysis is spread over, 0 does it all on the analysis thread, default one less than the cpu count, at most 7\n");
+    printf("    --silence-db\n    \tfloat, dBFS below which the input counts as silent, after a second of it the spectrum stops updating, default -70\n");
+    printf("    --input/-i\n    \tpath, analyze a wav (32 bit float or 16/32 bit pcm) or raw interleaved f32 file without PipeWire or a window and print throughput\n");
+    printf("    --quantum\n    \tint, frames per buffer fed to the analysis in --input mode, default 1024\n");
+    printf("    --input-rate\n    \tint, sample rate of raw --input files, default 48000\n");
+    printf("    --input-channels\n    \tint, channels of raw --input files, default 2\n");
+    printf("    --record\n    \tpath, write every buffer received from PipeWire to a capture file, for --replay\n");
+    printf("    --replay\n    \tpath, run a capture file from --record through the analysis without PipeWire or a window and print throughput\n");
+    printf("    --replay-realtime\n    \ttoggle, in --replay mode, keep the original timing between buffers instead of going as fast as possible\n");
+    printf("    --export-shm\n    \tname, publish every analysis frame in /dev/shm/name for other processes instead of opening a window, see pav_export.h, works with --input and --replay too\n");
+    printf("    --pw-source/-s\n    \tint, PipeWire node to source audio from, see --pw-list-nodes, can be given up to 8 times to show several nodes stacked in one window, --record only takes the first\n");
     printf("    --pw-list-nodes\n    \tlist all PipeWire nodes\n");
 }
 
@@ -240,7 +287,149 @@ int cli_parse(int argc, char **argv, opts_t *opts) {
         }
 
         if ((!strcmp(arg, "--pw-source") || !strcmp(arg, "-s")) && i + 1 < argc) {
-            sscanf(argv[++i], "%d", &opts->pw_source);
+            if (opts->n_pw_sources == MAX_SOURCES) {
+                fprintf(stderr, "at most %d --pw-source, ignoring %s\n", MAX_SOURCES, argv[++i]);
+                continue;
+            }
+
+            sscanf(argv[++i], "%d", &opts->pw_sources[opts->n_pw_sources++]);
+            continue;
+        }
+
+        if (!strcmp(arg, "--ring-size") && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d", &opts->ring_kib) != 1 || opts->ring_kib <= 0) {
+                fprintf(stderr, "bad ring size: %s, see --help\n", argv[i]);
+                return 0;
+            }
+
+            opts->ring_kib = MIN(MAX(opts->ring_kib, RING_MIN_KIB), RING_MAX_KIB);
+            continue;
+        }
+
+        if (!strcmp(arg, "--fft-size") && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &opts->fft_size);
+            continue;
+        }
+
+        if (!strcmp(arg, "--hop") && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &opts->hop);
+            continue;
+        }
+
+        if (!strcmp(arg, "--agc-target") && i + 1 < argc) {
+            sscanf(argv[++i], "%f", &opts->agc_target);
+            continue;
+        }
+
+        if (!strcmp(arg, "--agc-attack") && i + 1 < argc) {
+            sscanf(argv[++i], "%f", &opts->agc_attack_ms);
+            continue;
+        }
+
+        if (!strcmp(arg, "--agc-release") && i + 1 < argc) {
+            sscanf(argv[++i], "%f", &opts->agc_release_ms);
+            continue;
+        }
+
+        if (!strcmp(arg, "--scale") && i + 1 < argc) {
+            int scale = band_scale_parse(argv[++i]);
+            if (scale < 0) {
+                fprintf(stderr, "unknown scale: %s, see --help\n", argv[i]);
+                return 0;
+            }
+
+            opts->band_scale = scale;
+            continue;
+        }
+
+        if (!strcmp(arg, "--renderer") && i + 1 < argc) {
+            int renderer = renderer_parse(argv[++i]);
+            if (renderer < 0) {
+                fprintf(stderr, "unknown renderer: %s, see --help\n", argv[i]);
+                return 0;
+            }
+
+            opts->renderer = renderer;
+            continue;
+        }
+
+        if (!strcmp(arg, "--bands") && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &opts->n_bands);
+            continue;
+        }
+
+        if (!strcmp(arg, "--idle-fps") && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &opts->idle_fps);
+            continue;
+        }
+
+        if (!strcmp(arg, "--history") && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &opts->history);
+            continue;
+        }
+
+        if (!strcmp(arg, "--workers") && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &opts->workers);
+            continue;
+        }
+
+        if (!strcmp(arg, "--silence-db") && i + 1 < argc) {
+            sscanf(argv[++i], "%f", &opts->silence_db);
+            continue;
+        }
+
+        if ((!strcmp(arg, "--input") || !strcmp(arg, "-i")) && i + 1 < argc) {
+            opts->input = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(arg, "--quantum") && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &opts->quantum);
+            continue;
+        }
+
+        if (!strcmp(arg, "--input-rate") && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &opts->input_rate);
+            continue;
+        }
+
+        if (!strcmp(arg, "--input-channels") && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &opts->input_channels);
+            continue;
+        }
+
+        if (!strcmp(arg, "--record") && i + 1 < argc) {
+            opts->record = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(arg, "--replay") && i + 1 < argc) {
+            opts->replay = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(arg, "--metrics") && i + 1 < argc) {
+            opts->metrics = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(arg, "--metrics-interval") && i + 1 < argc) {
+            sscanf(argv[++i], "%d", &opts->metrics_interval_ms);
+            continue;
+        }
+
+        if (!strcmp(arg, "--export-shm") && i + 1 < argc) {
+            opts->export_shm = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(arg, "--palette") && i + 1 < argc) {
+            opts->palette = argv[++i];
+            continue;
+        }
+
+        if (!strcmp(arg, "--palette-alt") && i + 1 < argc) {
+            opts->palette_alt = argv[++i];
             continue;
         }
 
@@ -254,6 +443,11 @@ int cli_parse(int argc, char **argv, opts_t *opts) {
             continue;
         }
 
+        if (!strcmp(arg, "--replay-realtime")) {
+            opts->replay_realtime = 1;
+            continue;
+        }
+
         if (!strcmp(arg, "--log-timings")) {
             opts->log_timings = 1;
             continue;
@@ -272,12 +466,32 @@ int cli_parse(int argc, char **argv, opts_t *opts) {
         if (!strcmp(arg, "--mirror")) {
             opts->mirror = 1;
             opts->two_channels = 0;
+            opts->all_channels = 0;
+            opts->spectrogram = 0;
             continue;
         }
 
         if (!strcmp(arg, "--two-channels")) {
             opts->mirror = 0;
             opts->two_channels = 1;
+            opts->all_channels = 0;
+            opts->spectrogram = 0;
+            continue;
+        }
+
+        if (!strcmp(arg, "--all-channels")) {
+            opts->mirror = 0;
+            opts->two_channels = 0;
+            opts->all_channels = 1;
+            opts->spectrogram = 0;
+            continue;
+        }
+
+        if (!strcmp(arg, "--spectrogram")) {
+            opts->mirror = 0;
+            opts->two_channels = 0;
+            opts->all_channels = 0;
+            opts->spectrogram = 1;
             continue;
         }
     }
@@ -291,73 +505,184 @@ int main(int argc, char **argv) {
         .sample_boost = 1,
         .width = 0,
         .height = 0,
-        .pw_source = 0,
+        .n_pw_sources = 0,
+        .ring_kib = 1024,
+        .fft_size = 2048,
+        .hop = 512,
+        .agc_target = 1.2,
+        .agc_attack_ms = 300,
+        .agc_release_ms = 3000,
+        .band_scale = BAND_SCALE_LOG,
+        .n_bands = 256,
+        .idle_fps = 5,
+        .silence_db = -70,
+        // resolved from the cpu count below
+        .workers = -1,
         .font = NULL,
+        .input = NULL,
+        .quantum = 1024,
+        .input_rate = 48000,
+        .input_channels = 2,
+        .record = NULL,
+        .replay = NULL,
+        .replay_realtime = 0,
+        .metrics = NULL,
+        .metrics_interval_ms = 1000,
         .unlimited_fps = 0,
         .log_timings = 0,
         .flip_colors = 0,
         .split_waves = 0,
         .mirror = 0,
         .two_channels = 0,
+        .all_channels = 0,
+        .spectrogram = 0,
+        .history = 512,
+        .renderer = RENDERER_IMMEDIATE,
+        .palette = NULL,
+        .palette_alt = NULL,
+        .export_shm = NULL,
     };
 
     if (!cli_parse(argc, argv, &opts)) {
         return 0;
     }
 
+    // leaves a core for PipeWire and the renderer, more than 8 channels wide is rare
+    if (opts.workers < 0)
+        opts.workers = MIN(MAX(sysconf(_SC_NPROCESSORS_ONLN) - 1, 0), 7);
+
+    // offline and replay only ever have the one
     ctx_t ctx = {
-        .opts = opts
+        .opts = opts,
+        .n_sources = opts.input == NULL && opts.replay == NULL ? MAX(opts.n_pw_sources, 1) : 1,
     };
 
-    pthread_t tid;
-    pthread_create(&tid, NULL, draw_thread_init, &ctx);
+    metrics_init(&ctx.metrics);
+
+    if (ctx.opts.export_shm != NULL && exporter_start(&ctx.exporter, ctx.opts.export_shm, ctx.n_sources, MAX(ctx.opts.n_bands, 1)) < 0)
+        return 1;
+
+    if (ctx.opts.input != NULL) {
+        int ret = run_offline(&ctx);
+        analysis_free_frames(&ctx);
+        exporter_stop(&ctx.exporter);
+
+        return ret < 0;
+    }
+
+    if (ctx.opts.replay != NULL) {
+        int ret = run_replay(&ctx);
+        analysis_free_frames(&ctx);
+        exporter_stop(&ctx.exporter);
+
+        return ret < 0;
+    }
+
+    // exporting is headless, the process runs until it's interrupted
+    bool window = ctx.opts.export_shm == NULL;
+
+    // only the window uses them, but a bad --palette shouldn't get as far as connecting
+    if (palettes_init(&ctx) < 0) {
+        exporter_stop(&ctx.exporter);
+        return 1;
+    }
 
     pw_init(&argc, &argv);
 
+    // one loop, context and connection for every stream
     ctx.loop = pw_main_loop_new(NULL);
+    ctx.context = pw_context_new(pw_main_loop_get_loop(ctx.loop), NULL, 0);
+    if (ctx.context == NULL || (ctx.core = pw_context_connect(ctx.context, NULL, 0)) == NULL) {
+        fprintf(stderr, "can't connect to PipeWire: %m\n");
+        exporter_stop(&ctx.exporter);
+        return 1;
+    }
 
     pw_loop_add_signal(pw_main_loop_get_loop(ctx.loop), SIGINT, do_quit, &ctx);
     pw_loop_add_signal(pw_main_loop_get_loop(ctx.loop), SIGTERM, do_quit, &ctx);
 
-    struct pw_properties *props = pw_properties_new(
-            PW_KEY_MEDIA_TYPE, "Audio",
-            PW_KEY_MEDIA_CATEGORY, "Capture",
-            PW_KEY_MEDIA_ROLE, "Music",
-            NULL);
+    if (ctx.opts.record != NULL && recorder_start(&ctx.recorder, ctx.opts.record, (size_t) ctx.opts.ring_kib * 1024) < 0) {
+        exporter_stop(&ctx.exporter);
+        return 1;
+    }
+
+    pthread_t analysis_tid;
+    analysis_thread_start(&ctx, &analysis_tid);
+
+    if (ctx.opts.log_timings || ctx.opts.metrics != NULL)
+        metrics_reporter_start(&ctx);
 
-    ctx.stream = pw_stream_new_simple(
-            pw_main_loop_get_loop(ctx.loop),
-            "audio-visualizer",
-            props,
-            &stream_events,
-            &ctx);
+    atomic_init(&ctx.render_quit, false);
+
+    pthread_t tid;
+    if (window)
+        pthread_create(&tid, NULL, draw_thread_init, &ctx);
 
-    uint8_t buffer[1024];
+    // room for every offered format
+    uint8_t buffer[4096];
     struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 
-    const struct spa_pod *params[1] = {
-        spa_format_audio_raw_build(
-            &b,
-            SPA_PARAM_EnumFormat,
-            &SPA_AUDIO_INFO_RAW_INIT(
-                .format = SPA_AUDIO_FORMAT_F32))
-    };
+    const struct spa_pod *params[N_OFFERED_FORMATS];
+    for (size_t i = 0; i < N_OFFERED_FORMATS; i++) {
+        params[i] = spa_format_audio_raw_build(
+                &b,
+                SPA_PARAM_EnumFormat,
+                &SPA_AUDIO_INFO_RAW_INIT(
+                    .format = offered_formats[i]));
+    }
 
-    pw_stream_connect(ctx.stream,
-            PW_DIRECTION_INPUT,
-            ctx.opts.pw_source,
-            PW_STREAM_FLAG_AUTOCONNECT |
-            PW_STREAM_FLAG_MAP_BUFFERS |
-            PW_STREAM_FLAG_RT_PROCESS,
-            params, 1);
+    for (size_t i = 0; i < ctx.n_sources; i++) {
+        source_t *source = &ctx.sources[i];
+        source->node = ctx.opts.n_pw_sources > 0 ? ctx.opts.pw_sources[i] : 0;
+
+        // the stream takes ownership of these, so every one gets its own
+        struct pw_properties *props = pw_properties_new(
+                PW_KEY_MEDIA_TYPE, "Audio",
+                PW_KEY_MEDIA_CATEGORY, "Capture",
+                PW_KEY_MEDIA_ROLE, "Music",
+                NULL);
+
+        source->stream = pw_stream_new(ctx.core, "audio-visualizer", props);
+        pw_stream_add_listener(source->stream, &source->listener, &stream_events, source);
+
+        pw_stream_connect(source->stream,
+                PW_DIRECTION_INPUT,
+                source->node,
+                PW_STREAM_FLAG_AUTOCONNECT |
+                PW_STREAM_FLAG_MAP_BUFFERS |
+                PW_STREAM_FLAG_RT_PROCESS,
+                params, N_OFFERED_FORMATS);
+    }
 
     pw_main_loop_run(ctx.loop);
 
-    CloseWindow();
+    // the renderer reads the frames and the wakeup, it has to be gone before the analysis goes,
+    //  the window is closed on its own thread
+    if (window) {
+        atomic_store(&ctx.render_quit, true);
+        sem_post(&ctx.render_wakeup);
+        pthread_join(tid, NULL);
+    }
+
+    for (size_t i = 0; i < ctx.n_sources; i++)
+        pw_stream_destroy(ctx.sources[i].stream);
 
-    pw_stream_destroy(ctx.stream);
+    if (ctx.opts.record != NULL)
+        recorder_stop(&ctx.recorder);
+
+    metrics_reporter_stop(&ctx);
+    analysis_thread_stop(&ctx, analysis_tid);
+
+    if (ctx.opts.log_timings)
+        metrics_print_totals(&ctx.metrics, stderr);
+
+    pw_core_disconnect(ctx.core);
+    pw_context_destroy(ctx.context);
     pw_main_loop_destroy(ctx.loop);
     pw_deinit();
 
+    analysis_free_frames(&ctx);
+    exporter_stop(&ctx.exporter);
+
     return 0;
 }
@@ -0,0 +1,351 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<inttypes.h>
+#include<string.h>
+#include<time.h>
+#include<errno.h>
+#include<pthread.h>
+#include<semaphore.h>
+#include<stdatomic.h>
+
+#include "util.h"
+
+// per stage timings, safe to record from the RT thread
+//  recording is a handful of relaxed atomic adds into fixed histograms, no locks,
+//  no allocation and no io, a reporter thread of its own reads them every
+//  --metrics-interval and prints them (--log-timings) or rewrites a stats file (--metrics)
+
+const char *metric_stage_names[] = {
+    [METRIC_PROCESS] = "process",
+    [METRIC_CYCLE] = "cycle",
+    [METRIC_QUEUE] = "queue",
+    [METRIC_SPLIT] = "split",
+    [METRIC_AGC] = "agc",
+    [METRIC_FFT] = "fft",
+    [METRIC_ANALYSIS] = "analysis",
+    [METRIC_RENDER] = "render",
+    [METRIC_FRAME] = "frame",
+    [METRIC_LATENCY] = "latency",
+};
+
+int64_t metrics_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t) now.tv_sec * NANOS_PER_SEC + now.tv_nsec;
+}
+
+// exact below 8ns, then 8 linear steps per power of two, so within ~12%
+static size_t metrics_bucket(uint64_t ns) {
+    if (ns < 8)
+        return ns;
+
+    int msb = 63 - __builtin_clzll(ns);
+    size_t sub = (ns >> (msb - 3)) & 7;
+
+    return (msb - 2) * 8 + sub;
+}
+
+// middle of the bucket
+static double metrics_bucket_ns(size_t bucket) {
+    if (bucket < 8)
+        return bucket;
+
+    int msb = bucket / 8 + 2;
+    uint64_t lower = (8 + bucket % 8) << (msb - 3);
+    uint64_t width = (uint64_t) 1 << (msb - 3);
+
+    return lower + width / 2.0;
+}
+
+static void stage_record(stage_metrics_t *m, int64_t ns) {
+    uint64_t value = MAX(ns, 0);
+
+    atomic_fetch_add_explicit(&m->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->total_ns, value, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->buckets[metrics_bucket(value)], 1, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&m->max_ns, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&m->max_ns, &max, value, memory_order_relaxed, memory_order_relaxed));
+}
+
+// stages that aren't any one source's, the renderer's
+void metrics_record(metrics_t *metrics, metric_stage_t stage, int64_t ns) {
+    stage_record(&metrics->stages[0][stage], ns);
+}
+
+void metrics_record_source(metrics_t *metrics, size_t source, metric_stage_t stage, int64_t ns) {
+    stage_record(&metrics->stages[1 + source][stage], ns);
+}
+
+// records now - start, returns now so stages can be chained
+int64_t metrics_since(metrics_t *metrics, metric_stage_t stage, int64_t start) {
+    int64_t now = metrics_now();
+    metrics_record(metrics, stage, now - start);
+
+    return now;
+}
+
+int64_t metrics_since_source(metrics_t *metrics, size_t source, metric_stage_t stage, int64_t start) {
+    int64_t now = metrics_now();
+    metrics_record_source(metrics, source, stage, now - start);
+
+    return now;
+}
+
+// once per drawn frame, from the render thread
+void metrics_count_frame(metrics_t *metrics, uint64_t draws, uint64_t vertices) {
+    atomic_fetch_add_explicit(&metrics->frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&metrics->draws, draws, memory_order_relaxed);
+    atomic_fetch_add_explicit(&metrics->vertices, vertices, memory_order_relaxed);
+}
+
+void metrics_init(metrics_t *metrics) {
+    memset(metrics->stages, 0, sizeof(metrics->stages));
+    atomic_init(&metrics->frames, 0);
+    atomic_init(&metrics->draws, 0);
+    atomic_init(&metrics->vertices, 0);
+    metrics->running = false;
+}
+
+// every stage of every table
+#define METRICS_SNAPSHOT_SIZE (METRICS_TABLES * METRIC_COUNT)
+
+// a copy of one stage, totals or the difference between two copies
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint32_t buckets[METRICS_BUCKETS];
+} stage_snapshot_t;
+
+// the draw counters, same idea
+typedef struct {
+    uint64_t frames;
+    uint64_t draws;
+    uint64_t vertices;
+} draw_snapshot_t;
+
+static void metrics_draw_snapshot(metrics_t *metrics, draw_snapshot_t *dst) {
+    dst->frames = atomic_load_explicit(&metrics->frames, memory_order_relaxed);
+    dst->draws = atomic_load_explicit(&metrics->draws, memory_order_relaxed);
+    dst->vertices = atomic_load_explicit(&metrics->vertices, memory_order_relaxed);
+}
+
+// nothing for headless runs, they never draw
+static void metrics_print_draws(draw_snapshot_t *s, FILE *out) {
+    if (s->frames == 0)
+        return;
+
+    fprintf(out, "# draws per frame %.1f | vertices per frame %.0f | frames %" PRIu64 "\n",
+            (double) s->draws / s->frames, (double) s->vertices / s->frames, s->frames);
+}
+
+// index is the source the ring belongs to
+void print_ring_stats(size_t index, spsc_ring_t *ring) {
+    size_t used = spsc_ring_used(ring);
+    size_t high_water = atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+
+    fprintf(stderr, "ring %zu: used %zu/%zu bytes (%.1f%%) | high water %zu (%.1f%%) | chunks %" PRIu64 " | overruns %" PRIu64 "\n",
+            index, used, ring->capacity, 100.0 * used / ring->capacity,
+            high_water, 100.0 * high_water / ring->capacity,
+            atomic_load_explicit(&ring->commits, memory_order_relaxed),
+            atomic_load_explicit(&ring->overruns, memory_order_relaxed));
+}
+
+// the counters aren't read all at once, so a snapshot can be a few samples off, fine for stats
+static void metrics_snapshot(metrics_t *metrics, stage_snapshot_t *dst) {
+    for (size_t i = 0; i < METRICS_SNAPSHOT_SIZE; i++) {
+        stage_metrics_t *m = &metrics->stages[i / METRIC_COUNT][i % METRIC_COUNT];
+
+        dst[i].count = atomic_load_explicit(&m->count, memory_order_relaxed);
+        dst[i].total_ns = atomic_load_explicit(&m->total_ns, memory_order_relaxed);
+        dst[i].max_ns = atomic_load_explicit(&m->max_ns, memory_order_relaxed);
+
+        for (size_t j = 0; j < METRICS_BUCKETS; j++)
+            dst[i].buckets[j] = atomic_load_explicit(&m->buckets[j], memory_order_relaxed);
+    }
+}
+
+static double metrics_percentile(stage_snapshot_t *s, double p) {
+    uint64_t rank = p * s->count;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+        seen += s->buckets[i];
+        if (seen > rank)
+            return s->max_ns > 0 ? MIN(metrics_bucket_ns(i), s->max_ns) : metrics_bucket_ns(i);
+    }
+
+    return s->max_ns;
+}
+
+static void metrics_print_table(stage_snapshot_t *table, FILE *out) {
+    fprintf(out, "stage\tcount\tmean_us\tp50_us\tp95_us\tp99_us\tmax_us\n");
+
+    for (size_t i = 0; i < METRIC_COUNT; i++) {
+        stage_snapshot_t *s = &table[i];
+        if (s->count == 0)
+            continue;
+
+        fprintf(out, "%s\t%" PRIu64 "\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\n",
+                metric_stage_names[i], s->count, s->total_ns / 1000.0 / s->count,
+                metrics_percentile(s, 0.50) / 1000, metrics_percentile(s, 0.95) / 1000,
+                metrics_percentile(s, 0.99) / 1000, s->max_ns / 1000.0);
+    }
+}
+
+// tab separated, times in us, a table per source and one for the renderer,
+//  each under a # line like the ring stats, stages and tables that saw nothing are left out
+void metrics_print(stage_snapshot_t *snapshot, FILE *out) {
+    for (size_t t = 0; t < METRICS_TABLES; t++) {
+        stage_snapshot_t *table = &snapshot[t * METRIC_COUNT];
+
+        bool any = false;
+        for (size_t i = 0; i < METRIC_COUNT; i++)
+            any |= table[i].count > 0;
+
+        if (!any)
+            continue;
+
+        if (t == 0)
+            fprintf(out, "# render\n");
+        else
+            fprintf(out, "# source %zu\n", t - 1);
+
+        metrics_print_table(table, out);
+    }
+}
+
+// everything recorded so far, for headless runs and the end of a live one
+void metrics_print_totals(metrics_t *metrics, FILE *out) {
+    stage_snapshot_t *snapshot = malloc(METRICS_SNAPSHOT_SIZE * sizeof(*snapshot));
+
+    metrics_snapshot(metrics, snapshot);
+    metrics_print(snapshot, out);
+
+    draw_snapshot_t draws;
+    metrics_draw_snapshot(metrics, &draws);
+    metrics_print_draws(&draws, out);
+
+    free(snapshot);
+}
+
+// written next to the real file and renamed over it, readers never see half of it
+static void metrics_write_file(ctx_t *ctx, const char *path, stage_snapshot_t *interval, draw_snapshot_t *draws) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *file = fopen(tmp, "w");
+    if (file == NULL)
+        return;
+
+    for (size_t i = 0; i < ctx->n_sources; i++) {
+        spsc_ring_t *ring = &ctx->sources[i].ring;
+
+        fprintf(file, "# ring %zu used %zu/%zu bytes | overruns %" PRIu64 "\n", i,
+                spsc_ring_used(ring), ring->capacity,
+                atomic_load_explicit(&ring->overruns, memory_order_relaxed));
+    }
+
+    metrics_print_draws(draws, file);
+    metrics_print(interval, file);
+
+    fclose(file);
+    rename(tmp, path);
+}
+
+void *metrics_thread_init(void *_ctx) {
+    ctx_t *ctx = _ctx;
+    metrics_t *metrics = &ctx->metrics;
+
+    stage_snapshot_t *prev = calloc(METRICS_SNAPSHOT_SIZE, sizeof(*prev));
+    stage_snapshot_t *curr = malloc(METRICS_SNAPSHOT_SIZE * sizeof(*curr));
+    stage_snapshot_t *interval = malloc(METRICS_SNAPSHOT_SIZE * sizeof(*interval));
+
+    draw_snapshot_t prev_draws = {0};
+
+    long interval_ms = MAX(ctx->opts.metrics_interval_ms, 1);
+
+    while (!atomic_load(&metrics->quit)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        deadline.tv_nsec += interval_ms % 1000 * 1000000;
+        deadline.tv_sec += interval_ms / 1000 + deadline.tv_nsec / NANOS_PER_SEC;
+        deadline.tv_nsec %= NANOS_PER_SEC;
+
+        // woken early only to quit
+        while (sem_timedwait(&metrics->wakeup, &deadline) < 0 && errno == EINTR);
+
+        metrics_snapshot(metrics, curr);
+
+        for (size_t i = 0; i < METRICS_SNAPSHOT_SIZE; i++) {
+            interval[i].count = curr[i].count - prev[i].count;
+            interval[i].total_ns = curr[i].total_ns - prev[i].total_ns;
+            interval[i].max_ns = 0;
+
+            // the exact max is only kept for the whole run, this is the top bucket's
+            for (size_t j = 0; j < METRICS_BUCKETS; j++) {
+                interval[i].buckets[j] = curr[i].buckets[j] - prev[i].buckets[j];
+                if (interval[i].buckets[j] > 0)
+                    interval[i].max_ns = metrics_bucket_ns(j);
+            }
+        }
+
+        draw_snapshot_t curr_draws;
+        metrics_draw_snapshot(metrics, &curr_draws);
+
+        draw_snapshot_t interval_draws = {
+            .frames = curr_draws.frames - prev_draws.frames,
+            .draws = curr_draws.draws - prev_draws.draws,
+            .vertices = curr_draws.vertices - prev_draws.vertices,
+        };
+
+        prev_draws = curr_draws;
+
+        if (ctx->opts.log_timings) {
+            for (size_t i = 0; i < ctx->n_sources; i++)
+                print_ring_stats(i, &ctx->sources[i].ring);
+
+            metrics_print_draws(&interval_draws, stderr);
+            metrics_print(interval, stderr);
+        }
+
+        if (ctx->opts.metrics != NULL)
+            metrics_write_file(ctx, ctx->opts.metrics, interval, &interval_draws);
+
+        stage_snapshot_t *tmp = prev;
+        prev = curr;
+        curr = tmp;
+    }
+
+    free(prev);
+    free(curr);
+    free(interval);
+
+    return NULL;
+}
+
+void metrics_reporter_start(ctx_t *ctx) {
+    metrics_t *metrics = &ctx->metrics;
+
+    sem_init(&metrics->wakeup, 0, 0);
+    atomic_init(&metrics->quit, false);
+
+    metrics->running = pthread_create(&metrics->tid, NULL, metrics_thread_init, ctx) == 0;
+}
+
+void metrics_reporter_stop(ctx_t *ctx) {
+    metrics_t *metrics = &ctx->metrics;
+    if (!metrics->running)
+        return;
+
+    atomic_store(&metrics->quit, true);
+    sem_post(&metrics->wakeup);
+
+    pthread_join(metrics->tid, NULL);
+    sem_destroy(&metrics->wakeup);
+    metrics->running = false;
+}
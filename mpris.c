@@ -0,0 +1,402 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<stdbool.h>
+#include<string.h>
+#include<pthread.h>
+#include<stdatomic.h>
+#include<dbus/dbus.h>
+
+// now playing metadata from any MPRIS player (org.mpris.MediaPlayer2.*)
+//  a thread of its own listens for PropertiesChanged, so the renderer never waits on D-Bus,
+//  the player shown is the last one that started playing, the strings are owned copies
+//  handed over through a triple buffer like the analysis frames, see frames.c
+
+#define MPRIS_PREFIX "org.mpris.MediaPlayer2."
+#define MPRIS_PATH "/org/mpris/MediaPlayer2"
+#define MPRIS_PLAYER "org.mpris.MediaPlayer2.Player"
+
+// only ever waited on by the metadata thread
+#define MPRIS_TIMEOUT_MS 500
+// how often the thread checks if it should quit
+#define MPRIS_POLL_MS 250
+
+#define MPRIS_SLOTS 3
+#define MPRIS_FRESH 0x4
+#define MPRIS_INDEX 0x3
+
+typedef struct {
+    // NULL when nothing is playing, artist may be NULL on its own
+    char *artist;
+    char *title;
+    // changes with every new track
+    uint64_t sequence;
+} track_t;
+
+typedef struct {
+    track_t slots[MPRIS_SLOTS];
+
+    // owned by the metadata thread
+    uint32_t write;
+    uint64_t published;
+    // unique bus name of the player being shown
+    char *owner;
+    // owned by the render thread
+    uint32_t read;
+    // shared, slot index plus a "fresh" bit
+    _Atomic uint32_t middle;
+
+    atomic_bool quit;
+    pthread_t tid;
+    bool running;
+} mpris_t;
+
+// metadata thread side, takes ownership of the strings
+static void mpris_publish(mpris_t *mpris, char *artist, char *title) {
+    track_t *slot = &mpris->slots[mpris->write];
+
+    free(slot->artist);
+    free(slot->title);
+
+    slot->artist = artist;
+    slot->title = title;
+    slot->sequence = ++mpris->published;
+
+    uint32_t prev = atomic_exchange_explicit(&mpris->middle, mpris->write | MPRIS_FRESH, memory_order_acq_rel);
+    mpris->write = prev & MPRIS_INDEX;
+}
+
+// render thread side, stays valid and untouched until the next call
+track_t *mpris_read(mpris_t *mpris) {
+    if (atomic_load_explicit(&mpris->middle, memory_order_relaxed) & MPRIS_FRESH) {
+        uint32_t prev = atomic_exchange_explicit(&mpris->middle, mpris->read, memory_order_acq_rel);
+        mpris->read = prev & MPRIS_INDEX;
+    }
+
+    return &mpris->slots[mpris->read];
+}
+
+static void mpris_set_owner(mpris_t *mpris, const char *owner) {
+    free(mpris->owner);
+    mpris->owner = owner != NULL ? strdup(owner) : NULL;
+}
+
+// a string, or the first of an array of them (xesam:artist), as an owned copy
+static char *mpris_dup_string(DBusMessageIter *value) {
+    DBusMessageIter array;
+    const char *str = NULL;
+
+    if (dbus_message_iter_get_arg_type(value) == DBUS_TYPE_ARRAY) {
+        dbus_message_iter_recurse(value, &array);
+        value = &array;
+    }
+
+    if (dbus_message_iter_get_arg_type(value) != DBUS_TYPE_STRING)
+        return NULL;
+
+    dbus_message_iter_get_basic(value, &str);
+
+    return strdup(str);
+}
+
+typedef struct {
+    bool has_metadata;
+    bool playing;
+    char *artist;
+    char *title;
+} mpris_properties_t;
+
+static void mpris_properties_free(mpris_properties_t *props) {
+    free(props->artist);
+    free(props->title);
+}
+
+// one entry of an a{sv}, false if it isn't shaped like one
+static bool mpris_dict_entry(DBusMessageIter *dict, const char **key, DBusMessageIter *value) {
+    DBusMessageIter entry;
+    dbus_message_iter_recurse(dict, &entry);
+
+    if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_STRING)
+        return false;
+
+    dbus_message_iter_get_basic(&entry, key);
+    dbus_message_iter_next(&entry);
+
+    if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_VARIANT)
+        return false;
+
+    dbus_message_iter_recurse(&entry, value);
+
+    return true;
+}
+
+// Metadata, a{sv}
+static void mpris_parse_metadata(DBusMessageIter *dict, mpris_properties_t *props) {
+    props->has_metadata = true;
+
+    while (dbus_message_iter_get_arg_type(dict) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter value;
+        const char *key;
+
+        if (!mpris_dict_entry(dict, &key, &value)) {
+            dbus_message_iter_next(dict);
+            continue;
+        }
+
+        if (!strcmp(key, "xesam:title") && props->title == NULL)
+            props->title = mpris_dup_string(&value);
+        else if (!strcmp(key, "xesam:artist") && props->artist == NULL)
+            props->artist = mpris_dup_string(&value);
+
+        dbus_message_iter_next(dict);
+    }
+}
+
+// the player's properties, a{sv}, as sent by GetAll and PropertiesChanged
+static int mpris_parse_properties(DBusMessageIter *iter, mpris_properties_t *props) {
+    *props = (mpris_properties_t) {0};
+
+    if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY)
+        return -1;
+
+    DBusMessageIter dict;
+    dbus_message_iter_recurse(iter, &dict);
+
+    while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter value;
+        const char *key;
+
+        if (!mpris_dict_entry(&dict, &key, &value)) {
+            dbus_message_iter_next(&dict);
+            continue;
+        }
+
+        int type = dbus_message_iter_get_arg_type(&value);
+
+        if (!strcmp(key, "Metadata") && type == DBUS_TYPE_ARRAY) {
+            DBusMessageIter metadata;
+            dbus_message_iter_recurse(&value, &metadata);
+            mpris_parse_metadata(&metadata, props);
+        } else if (!strcmp(key, "PlaybackStatus") && type == DBUS_TYPE_STRING) {
+            const char *status;
+            dbus_message_iter_get_basic(&value, &status);
+            props->playing = !strcmp(status, "Playing");
+        }
+
+        dbus_message_iter_next(&dict);
+    }
+
+    return 0;
+}
+
+// blocking, only called from the metadata thread, reply is NULL if the player didn't answer
+static DBusMessage *mpris_call(DBusConnection *conn, DBusMessage *msg) {
+    DBusError err;
+    dbus_error_init(&err);
+
+    DBusMessage *reply = dbus_connection_send_with_reply_and_block(conn, msg, MPRIS_TIMEOUT_MS, &err);
+    dbus_message_unref(msg);
+
+    if (dbus_error_is_set(&err))
+        dbus_error_free(&err);
+
+    return reply;
+}
+
+// all of a player's properties, owner is set to its unique name
+static int mpris_get_all(DBusConnection *conn, const char *name, mpris_properties_t *props, const char **owner, DBusMessage **reply) {
+    DBusMessage *msg = dbus_message_new_method_call(name, MPRIS_PATH, DBUS_INTERFACE_PROPERTIES, "GetAll");
+    if (msg == NULL)
+        return -1;
+
+    const char *interface = MPRIS_PLAYER;
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &interface, DBUS_TYPE_INVALID);
+
+    if ((*reply = mpris_call(conn, msg)) == NULL)
+        return -1;
+
+    DBusMessageIter iter;
+    if (!dbus_message_iter_init(*reply, &iter) || mpris_parse_properties(&iter, props) < 0) {
+        dbus_message_unref(*reply);
+        return -1;
+    }
+
+    *owner = dbus_message_get_sender(*reply);
+
+    return 0;
+}
+
+// goes through every player on the bus, the first one playing wins, then the first with a title
+static void mpris_pick_player(mpris_t *mpris, DBusConnection *conn) {
+    DBusMessage *msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS, "ListNames");
+    DBusMessage *names = msg != NULL ? mpris_call(conn, msg) : NULL;
+
+    mpris_properties_t best = {0};
+    char *best_owner = NULL;
+
+    DBusMessageIter iter, array;
+    if (names != NULL && dbus_message_iter_init(names, &iter) && dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY) {
+        dbus_message_iter_recurse(&iter, &array);
+
+        for (; dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRING && !best.playing; dbus_message_iter_next(&array)) {
+            const char *name;
+            dbus_message_iter_get_basic(&array, &name);
+
+            if (strncmp(name, MPRIS_PREFIX, strlen(MPRIS_PREFIX)))
+                continue;
+
+            mpris_properties_t props;
+            const char *owner;
+            DBusMessage *reply;
+            if (mpris_get_all(conn, name, &props, &owner, &reply) < 0)
+                continue;
+
+            if (props.title != NULL && (best.title == NULL || props.playing)) {
+                mpris_properties_free(&best);
+                free(best_owner);
+
+                best = props;
+                best_owner = strdup(owner);
+            } else {
+                mpris_properties_free(&props);
+            }
+
+            dbus_message_unref(reply);
+        }
+    }
+
+    if (names != NULL)
+        dbus_message_unref(names);
+
+    mpris_set_owner(mpris, best_owner);
+    mpris_publish(mpris, best.artist, best.title);
+
+    free(best_owner);
+}
+
+static void mpris_handle_properties_changed(mpris_t *mpris, DBusConnection *conn, DBusMessage *msg) {
+    const char *sender = dbus_message_get_sender(msg);
+    const char *interface;
+
+    DBusMessageIter iter;
+    if (sender == NULL || !dbus_message_iter_init(msg, &iter) || dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_STRING)
+        return;
+
+    dbus_message_iter_get_basic(&iter, &interface);
+    if (strcmp(interface, MPRIS_PLAYER) || !dbus_message_iter_next(&iter))
+        return;
+
+    mpris_properties_t props;
+    if (mpris_parse_properties(&iter, &props) < 0)
+        return;
+
+    bool is_owner = mpris->owner != NULL && !strcmp(sender, mpris->owner);
+
+    if (props.playing && !is_owner) {
+        // a different player started, it only said what changed so ask it for the rest
+        mpris_properties_free(&props);
+
+        const char *owner;
+        DBusMessage *reply;
+        if (mpris_get_all(conn, sender, &props, &owner, &reply) < 0)
+            return;
+
+        dbus_message_unref(reply);
+
+        mpris_set_owner(mpris, sender);
+        mpris_publish(mpris, props.artist, props.title);
+        return;
+    }
+
+    // metadata of players in the background is ignored
+    if (props.has_metadata && (is_owner || mpris->owner == NULL)) {
+        mpris_set_owner(mpris, sender);
+        mpris_publish(mpris, props.artist, props.title);
+        return;
+    }
+
+    mpris_properties_free(&props);
+}
+
+static void mpris_handle_name_owner_changed(mpris_t *mpris, DBusConnection *conn, DBusMessage *msg) {
+    const char *name, *old_owner, *new_owner;
+    if (!dbus_message_get_args(msg, NULL,
+                DBUS_TYPE_STRING, &name,
+                DBUS_TYPE_STRING, &old_owner,
+                DBUS_TYPE_STRING, &new_owner,
+                DBUS_TYPE_INVALID))
+        return;
+
+    // the player being shown went away, fall back to whatever else is there
+    if (mpris->owner != NULL && !strcmp(old_owner, mpris->owner) && new_owner[0] == '\0')
+        mpris_pick_player(mpris, conn);
+}
+
+void *mpris_thread_init(void *_mpris) {
+    mpris_t *mpris = _mpris;
+
+    DBusError err;
+    dbus_error_init(&err);
+
+    // private so nothing else in the process can read messages off it
+    DBusConnection *conn = dbus_bus_get_private(DBUS_BUS_SESSION, &err);
+    if (conn == NULL) {
+        fprintf(stderr, "mpris: no session bus: %s\n", dbus_error_is_set(&err) ? err.message : "unknown error");
+        dbus_error_free(&err);
+        return NULL;
+    }
+
+    dbus_connection_set_exit_on_disconnect(conn, FALSE);
+
+    dbus_bus_add_match(conn,
+            "type='signal',interface='" DBUS_INTERFACE_PROPERTIES "',member='PropertiesChanged',"
+            "path='" MPRIS_PATH "',arg0='" MPRIS_PLAYER "'", NULL);
+    dbus_bus_add_match(conn,
+            "type='signal',sender='" DBUS_SERVICE_DBUS "',interface='" DBUS_INTERFACE_DBUS "',"
+            "member='NameOwnerChanged',arg0namespace='org.mpris.MediaPlayer2'", NULL);
+
+    mpris_pick_player(mpris, conn);
+
+    while (!atomic_load(&mpris->quit) && dbus_connection_read_write(conn, MPRIS_POLL_MS)) {
+        DBusMessage *msg;
+        while ((msg = dbus_connection_pop_message(conn)) != NULL) {
+            if (dbus_message_is_signal(msg, DBUS_INTERFACE_PROPERTIES, "PropertiesChanged"))
+                mpris_handle_properties_changed(mpris, conn, msg);
+            else if (dbus_message_is_signal(msg, DBUS_INTERFACE_DBUS, "NameOwnerChanged"))
+                mpris_handle_name_owner_changed(mpris, conn, msg);
+
+            dbus_message_unref(msg);
+        }
+    }
+
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+
+    return NULL;
+}
+
+void mpris_start(mpris_t *mpris) {
+    *mpris = (mpris_t) {
+        .write = 0,
+        .read = 1,
+        .middle = 2,
+    };
+
+    atomic_init(&mpris->quit, false);
+
+    mpris->running = pthread_create(&mpris->tid, NULL, mpris_thread_init, mpris) == 0;
+}
+
+void mpris_stop(mpris_t *mpris) {
+    atomic_store(&mpris->quit, true);
+
+    if (mpris->running)
+        pthread_join(mpris->tid, NULL);
+
+    for (size_t i = 0; i < MPRIS_SLOTS; i++) {
+        free(mpris->slots[i].artist);
+        free(mpris->slots[i].title);
+    }
+
+    free(mpris->owner);
+}
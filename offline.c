@@ -0,0 +1,227 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<inttypes.h>
+#include<string.h>
+#include<time.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<errno.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+
+#include "util.h"
+
+// headless mode, streams an audio file through the analysis pipeline
+//  no PipeWire, no window, chunks are cut to --quantum frames like the server would,
+//  handy for profiling and for machines without an audio server or a display
+
+typedef struct {
+    uint8_t *map;
+    size_t map_size;
+
+    const uint8_t *data;
+    size_t n_frames;
+    uint32_t n_channels;
+    uint32_t rate;
+    sample_format_t format;
+} input_file_t;
+
+static uint16_t read_u16(const uint8_t *p) {
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t read_u32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+// fills in everything but the mapping, -1 if it's not a wav we can read
+static int parse_wav(input_file_t *in) {
+    const uint8_t *p = in->map;
+    size_t size = in->map_size;
+
+    if (size < 12 || memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4))
+        return -1;
+
+    bool have_format = false;
+    size_t offset = 12;
+    while (offset + 8 <= size) {
+        const uint8_t *chunk = p + offset;
+        size_t chunk_size = read_u32(chunk + 4);
+        const uint8_t *body = chunk + 8;
+
+        if (!memcmp(chunk, "fmt ", 4) && chunk_size >= 16) {
+            uint16_t tag = read_u16(body);
+            uint16_t bits = read_u16(body + 14);
+
+            // WAVE_FORMAT_EXTENSIBLE keeps the real tag at the start of the subformat guid
+            if (tag == 0xFFFE && chunk_size >= 26)
+                tag = read_u16(body + 24);
+
+            if (tag == 3 && bits == 32)
+                in->format = SAMPLE_F32;
+            else if (tag == 1 && bits == 16)
+                in->format = SAMPLE_S16;
+            else if (tag == 1 && bits == 32)
+                in->format = SAMPLE_S32;
+            else {
+                fprintf(stderr, "input: unsupported wav encoding (tag %d, %d bits), only 32 bit float and 16 or 32 bit pcm\n", tag, bits);
+                return -1;
+            }
+
+            in->n_channels = read_u16(body + 2);
+            in->rate = read_u32(body + 4);
+            have_format = true;
+        } else if (!memcmp(chunk, "data", 4) && have_format) {
+            size_t frame_bytes = in->n_channels * sample_size(in->format);
+            if (frame_bytes == 0)
+                return -1;
+
+            in->data = body;
+            in->n_frames = MIN(chunk_size, size - offset - 8) / frame_bytes;
+            return 0;
+        }
+
+        // chunks are padded to an even size
+        offset += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    return -1;
+}
+
+// read only mapping of a whole file, read front to back exactly once
+uint8_t *map_file(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: empty or unreadable\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "%s: mmap: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    *size = st.st_size;
+    return map;
+}
+
+// wav files describe themselves, anything else is taken as raw interleaved f32
+int input_open(input_file_t *in, const char *path, uint32_t raw_rate, uint32_t raw_channels) {
+    *in = (input_file_t) {0};
+
+    if ((in->map = map_file(path, &in->map_size)) == NULL)
+        return -1;
+
+    if (parse_wav(in) == 0)
+        return 0;
+
+    if (in->map_size >= 4 && !memcmp(in->map, "RIFF", 4)) {
+        fprintf(stderr, "input: %s looks like a wav file but couldn't be read\n", path);
+        munmap(in->map, in->map_size);
+        return -1;
+    }
+
+    in->format = SAMPLE_F32;
+    in->rate = raw_rate;
+    in->n_channels = raw_channels;
+    in->data = in->map;
+    in->n_frames = in->map_size / (raw_channels * sizeof(float));
+
+    return 0;
+}
+
+void input_close(input_file_t *in) {
+    munmap(in->map, in->map_size);
+}
+
+// throughput of a headless run that started at start
+void offline_report(ctx_t *ctx, struct timespec *start, size_t n_frames, size_t n_buffers, double audio_seconds) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    uint64_t published = ctx->sources[0].frames.published;
+
+    double seconds = timespec_diff_ns(start, &end) / NANOS_PER_SEC;
+
+    printf("offline: %zu frames | %zu buffers | %" PRIu64 " windows in %.3fs\n",
+            n_frames, n_buffers, published, seconds);
+    printf("offline: %.0f frames/s | %.0f buffers/s | %.0f windows/s | %.1fx realtime\n",
+            n_frames / seconds, n_buffers / seconds, published / seconds, audio_seconds / seconds);
+
+    metrics_print_totals(&ctx->metrics, stdout);
+}
+
+int run_offline(ctx_t *ctx) {
+    input_file_t in;
+    if (input_open(&in, ctx->opts.input, MAX(ctx->opts.input_rate, 1), MAX(ctx->opts.input_channels, 1)) < 0)
+        return -1;
+
+    if (in.n_channels == 0 || in.n_channels > MAX_CHANNELS || in.rate == 0) {
+        fprintf(stderr, "input: unsupported layout, %d channels at %dHz\n", in.n_channels, in.rate);
+        input_close(&in);
+        return -1;
+    }
+
+    printf("input: %s | %s | rate: %d | channels: %d | frames: %zu (%.2fs)\n",
+            ctx->opts.input, sample_format_names[in.format],
+            in.rate, in.n_channels, in.n_frames, (double) in.n_frames / in.rate);
+
+    size_t quantum = MAX(ctx->opts.quantum, 1);
+    size_t frame_bytes = in.n_channels * sample_size(in.format);
+
+    // wav chunks are only 2 byte aligned, a fmt chunk with an extension and a fact chunk
+    //  can leave the samples where f32 and s32 loads would be misaligned, those go through a copy
+    uint8_t *bounce = NULL;
+    if ((uintptr_t) in.data % sample_size(in.format) != 0)
+        bounce = malloc(quantum * frame_bytes);
+
+    analysis_init(ctx);
+
+    size_t n_buffers = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t frame = 0; frame < in.n_frames; frame += quantum) {
+        size_t n_frames = MIN(quantum, in.n_frames - frame);
+        // read straight out of the mapping, the stft converts as it takes the samples in
+        const uint8_t *samples = in.data + frame * frame_bytes;
+        if (bounce != NULL) {
+            memcpy(bounce, samples, n_frames * frame_bytes);
+            samples = bounce;
+        }
+
+        audio_chunk_t chunk = {
+            .n_samples = n_frames * in.n_channels,
+            .n_channels = in.n_channels,
+            .rate = in.rate,
+            .format = in.format,
+        };
+
+        int64_t analysis_start = metrics_now();
+        analyze_chunk(ctx, &ctx->sources[0], &chunk, samples);
+        metrics_since_source(&ctx->metrics, 0, METRIC_ANALYSIS, analysis_start);
+        n_buffers++;
+    }
+
+    offline_report(ctx, &start, in.n_frames, n_buffers, (double) in.n_frames / in.rate);
+
+    analysis_free(ctx);
+    input_close(&in);
+    free(bounce);
+
+    return 0;
+}
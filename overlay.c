@@ -0,0 +1,184 @@
+#include<stdlib.h>
+#include<stdint.h>
+#include<stdbool.h>
+#include<math.h>
+#include<raylib.h>
+#include<rlgl.h>
+
+#include "util.h"
+
+// now playing overlay
+//  the text only changes once per track, so it's laid out and drawn into a texture
+//  when it does and every frame after that is a single textured quad,
+//  a --font atlas starts out with printable ascii and only grows by what the titles use
+
+// artist above title, the atlas is rasterised at the biggest size drawn
+#define OVERLAY_ARTIST_SIZE 36
+#define OVERLAY_TITLE_SIZE 72
+#define OVERLAY_LINE_OFFSET 40
+
+// the default font looks right a bit smaller and with its usual spacing
+#define OVERLAY_DEFAULT_ARTIST_SIZE 32
+#define OVERLAY_DEFAULT_TITLE_SIZE 64
+
+typedef struct {
+    // --font file, read once and rasterised from memory whenever glyphs are added
+    unsigned char *file;
+    int file_size;
+    const char *file_type;
+
+    // every codepoint in the atlas
+    int *codepoints;
+    size_t n_codepoints;
+    size_t capacity;
+
+    Font font;
+
+    RenderTexture2D texture;
+    uint64_t sequence;
+    bool visible;
+} overlay_t;
+
+static bool overlay_has_codepoint(overlay_t *overlay, int codepoint) {
+    for (size_t i = 0; i < overlay->n_codepoints; i++) {
+        if (overlay->codepoints[i] == codepoint)
+            return true;
+    }
+
+    return false;
+}
+
+static void overlay_push_codepoint(overlay_t *overlay, int codepoint) {
+    if (overlay->n_codepoints == overlay->capacity) {
+        overlay->capacity = MAX(overlay->capacity * 2, 128);
+        overlay->codepoints = realloc(overlay->codepoints, overlay->capacity * sizeof(int));
+    }
+
+    overlay->codepoints[overlay->n_codepoints++] = codepoint;
+}
+
+// returns whether anything new was added, glyphs the font doesn't have are remembered too
+static bool overlay_add_glyphs(overlay_t *overlay, const char *text) {
+    if (text == NULL)
+        return false;
+
+    int count;
+    int *codepoints = LoadCodepoints(text, &count);
+
+    bool added = false;
+    for (int i = 0; i < count; i++) {
+        if (!overlay_has_codepoint(overlay, codepoints[i])) {
+            overlay_push_codepoint(overlay, codepoints[i]);
+            added = true;
+        }
+    }
+
+    UnloadCodepoints(codepoints);
+
+    return added;
+}
+
+static void overlay_load_font(overlay_t *overlay) {
+    if (overlay->font.texture.id != 0)
+        UnloadFont(overlay->font);
+
+    overlay->font = LoadFontFromMemory(overlay->file_type, overlay->file, overlay->file_size,
+            OVERLAY_TITLE_SIZE, overlay->codepoints, overlay->n_codepoints);
+}
+
+// without a font, or if it can't be read, raylib's default one is used
+void overlay_init(overlay_t *overlay, const char *font_path) {
+    *overlay = (overlay_t) {0};
+
+    if (font_path == NULL)
+        return;
+
+    if ((overlay->file = LoadFileData(font_path, &overlay->file_size)) == NULL)
+        return;
+
+    overlay->file_type = GetFileExtension(font_path);
+
+    for (int c = 0x20; c < 0x7F; c++)
+        overlay_push_codepoint(overlay, c);
+
+    overlay_load_font(overlay);
+}
+
+void overlay_free(overlay_t *overlay) {
+    if (overlay->texture.id != 0)
+        UnloadRenderTexture(overlay->texture);
+
+    if (overlay->font.texture.id != 0)
+        UnloadFont(overlay->font);
+
+    UnloadFileData(overlay->file);
+    free(overlay->codepoints);
+}
+
+// has to be called outside of BeginDrawing, does nothing unless the track changed
+void overlay_update(overlay_t *overlay, track_t *track) {
+    if (track->sequence == overlay->sequence)
+        return;
+
+    overlay->sequence = track->sequence;
+    overlay->visible = track->title != NULL;
+
+    if (!overlay->visible)
+        return;
+
+    const char *artist = track->artist != NULL ? track->artist : "";
+
+    bool custom = overlay->font.texture.id != 0;
+    if (custom) {
+        // both have to run, || would skip the title
+        bool added = overlay_add_glyphs(overlay, artist);
+        added |= overlay_add_glyphs(overlay, track->title);
+
+        if (added)
+            overlay_load_font(overlay);
+    }
+
+    Font font = custom ? overlay->font : GetFontDefault();
+    float artist_size = custom ? OVERLAY_ARTIST_SIZE : OVERLAY_DEFAULT_ARTIST_SIZE;
+    float title_size = custom ? OVERLAY_TITLE_SIZE : OVERLAY_DEFAULT_TITLE_SIZE;
+    // same spacing DrawText uses
+    float artist_spacing = custom ? 0 : artist_size / 10;
+    float title_spacing = custom ? 0 : title_size / 10;
+
+    Vector2 artist_bounds = MeasureTextEx(font, artist, artist_size, artist_spacing);
+    Vector2 title_bounds = MeasureTextEx(font, track->title, title_size, title_spacing);
+
+    int width = MAX(ceilf(MAX(artist_bounds.x, title_bounds.x)), 1);
+    int height = ceilf(OVERLAY_LINE_OFFSET + title_bounds.y);
+
+    // exactly the size of the text, so the whole texture can be drawn flipped
+    if (overlay->texture.texture.width != width || overlay->texture.texture.height != height) {
+        if (overlay->texture.id != 0)
+            UnloadRenderTexture(overlay->texture);
+
+        overlay->texture = LoadRenderTexture(width, height);
+    }
+
+    // BLEND_ALPHA would multiply the stored alpha by alpha as well, adding it up instead
+    //  leaves the texture premultiplied, colour and alpha both a, which is what overlay_draw expects
+    BeginTextureMode(overlay->texture);
+    ClearBackground(BLANK);
+    rlSetBlendFactorsSeparate(RL_SRC_ALPHA, RL_ONE_MINUS_SRC_ALPHA, RL_ONE, RL_ONE_MINUS_SRC_ALPHA, RL_FUNC_ADD, RL_FUNC_ADD);
+    BeginBlendMode(BLEND_CUSTOM_SEPARATE);
+    DrawTextEx(font, artist, (Vector2) { 0, 0 }, artist_size, artist_spacing, WHITE);
+    DrawTextEx(font, track->title, (Vector2) { 0, OVERLAY_LINE_OFFSET }, title_size, title_spacing, WHITE);
+    EndBlendMode();
+    EndTextureMode();
+}
+
+void overlay_draw(overlay_t *overlay, float x, float y) {
+    if (!overlay->visible)
+        return;
+
+    Texture2D texture = overlay->texture.texture;
+
+    // premultiplied, see overlay_update
+    BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+    DrawTextureRec(texture, (Rectangle) { 0, 0, texture.width, -texture.height }, (Vector2) { x, y }, WHITE);
+    EndBlendMode();
+}
@@ -0,0 +1,135 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<raylib.h>
+
+#include "util.h"
+
+// colour progressions quantised to PALETTE_SIZE entries
+//  built once at startup from color_progression/_alt or from --palette stops, after that picking
+//  a colour is a clamp, a multiply and an index, the lookups upload the same table as a texture
+
+#define PALETTE_MAX_STOPS 16
+
+// indices worked out per pass of palette_lookup, on the stack
+#define PALETTE_BATCH 64
+
+// the table, the way color_progression_fn(i / (PALETTE_SIZE - 1)) would fill it
+void palette_from_fn(palette_t *palette, Color (*color_progression_fn)(float)) {
+    for (size_t i = 0; i < PALETTE_SIZE; i++)
+        palette->colors[i] = color_progression_fn((float) i / (PALETTE_SIZE - 1));
+}
+
+// evenly spaced stops, blended linearly in between
+void palette_from_stops(palette_t *palette, const Color *stops, size_t n_stops) {
+    for (size_t i = 0; i < PALETTE_SIZE; i++) {
+        float position = (float) i / (PALETTE_SIZE - 1) * (n_stops - 1);
+        size_t stop = MIN((size_t) position, n_stops - 1);
+        size_t next = MIN(stop + 1, n_stops - 1);
+        float t = position - stop;
+
+        Color a = stops[stop];
+        Color b = stops[next];
+
+        palette->colors[i] = (Color) {
+            a.r + (b.r - a.r) * t + 0.5f,
+            a.g + (b.g - a.g) * t + 0.5f,
+            a.b + (b.b - a.b) * t + 0.5f,
+            a.a + (b.a - a.a) * t + 0.5f,
+        };
+    }
+}
+
+// comma separated rrggbb or rrggbbaa, a leading # is fine, -1 if it doesn't parse
+int palette_parse(palette_t *palette, const char *spec) {
+    Color stops[PALETTE_MAX_STOPS];
+    size_t n_stops = 0;
+
+    const char *p = spec;
+    while (*p != '\0') {
+        if (n_stops == PALETTE_MAX_STOPS) {
+            fprintf(stderr, "palette: %s has more than %d stops\n", spec, PALETTE_MAX_STOPS);
+            return -1;
+        }
+
+        if (*p == '#')
+            p++;
+
+        size_t digits = strspn(p, "0123456789abcdefABCDEF");
+        if (digits != 6 && digits != 8) {
+            fprintf(stderr, "palette: %s, stops are rrggbb or rrggbbaa\n", spec);
+            return -1;
+        }
+
+        char hex[9] = {0};
+        memcpy(hex, p, digits);
+        uint32_t value = strtoul(hex, NULL, 16);
+        if (digits == 6)
+            value = value << 8 | 0xFF;
+
+        stops[n_stops++] = (Color) { value >> 24, value >> 16, value >> 8, value };
+
+        p += digits;
+        if (*p == ',')
+            p++;
+        else if (*p != '\0') {
+            fprintf(stderr, "palette: %s, stops are separated by commas\n", spec);
+            return -1;
+        }
+    }
+
+    if (n_stops == 0) {
+        fprintf(stderr, "palette: no stops given\n");
+        return -1;
+    }
+
+    palette_from_stops(palette, stops, n_stops);
+
+    return 0;
+}
+
+// progress is clamped to 0-1
+static inline Color palette_color(const palette_t *palette, float progress) {
+    float index = MAX(MIN(progress, 1.0f), 0.0f) * (PALETTE_SIZE - 1) + 0.5f;
+
+    return palette->colors[(size_t) index];
+}
+
+// dst[i] = palette_color(palette, values[i] * scale)
+//  the quantising is branch free, so gcc turns it into a few vector instructions and only the indexing is left
+void palette_lookup(const palette_t *palette, const float *values, float scale, Color *dst, size_t n) {
+    uint32_t indices[PALETTE_BATCH];
+
+    for (size_t start = 0; start < n; start += PALETTE_BATCH) {
+        size_t count = MIN(n - start, PALETTE_BATCH);
+
+        for (size_t i = 0; i < count; i++) {
+            float index = MAX(MIN(values[start + i] * scale, 1.0f), 0.0f) * (PALETTE_SIZE - 1) + 0.5f;
+            indices[i] = index;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            dst[start + i] = palette->colors[indices[i]];
+    }
+}
+
+// primary and alternate palette, --flip-colors swaps them here so nothing after has to care
+int palettes_init(ctx_t *ctx) {
+    palette_t *palette = &ctx->palettes[ctx->opts.flip_colors ? 1 : 0];
+    palette_t *palette_alt = &ctx->palettes[ctx->opts.flip_colors ? 0 : 1];
+
+    if (ctx->opts.palette != NULL) {
+        if (palette_parse(palette, ctx->opts.palette) < 0)
+            return -1;
+    } else
+        palette_from_fn(palette, color_progression);
+
+    if (ctx->opts.palette_alt != NULL) {
+        if (palette_parse(palette_alt, ctx->opts.palette_alt) < 0)
+            return -1;
+    } else
+        palette_from_fn(palette_alt, color_progression_alt);
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+#ifndef __PAV_EXPORT
+#define __PAV_EXPORT
+
+#include<stddef.h>
+#include<stdint.h>
+#include<stdbool.h>
+#include<stdatomic.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+
+// --export-shm, analysis frames published in /dev/shm for other processes
+//  self contained, readers only need this header, nothing of PipeWire, Raylib or the analysis,
+//  the mapping is a pav_export_header_t, then a ring of n_slots frames per source, newest last,
+//  every slot is guarded by a seqlock so readers never block the writer and the writer never waits,
+//  frames are read in place and checked afterwards, a reader that lost the race just tries again
+
+#define PAV_EXPORT_MAGIC 0x45564150 // "PAVE"
+#define PAV_EXPORT_VERSION 1
+
+// per channel bands and rms are only exported for the first this many channels
+#define PAV_EXPORT_MAX_CHANNELS 8
+
+// everything is in host byte order, offsets are from the start of the mapping
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+
+    uint32_t n_sources;
+    uint32_t n_slots;
+    // every slot has room for max_bands bands per channel
+    uint32_t max_bands;
+    uint32_t max_channels;
+
+    uint64_t slot_size;
+    uint64_t rings_offset;
+    uint64_t ring_size;
+    uint64_t map_size;
+} pav_export_header_t;
+
+// at the start of each source's ring, its slots start PAV_EXPORT_SLOTS_OFFSET bytes in, slot_size apart
+typedef struct {
+    // frames written so far, the newest is in slot (written - 1) % n_slots
+    _Atomic uint64_t written;
+} pav_export_ring_t;
+
+#define PAV_EXPORT_SLOTS_OFFSET 64
+
+typedef struct {
+    // odd while the writer is in the middle of the slot
+    _Atomic uint32_t lock;
+    uint32_t source;
+
+    // the analysis' own frame sequence, goes up by one per frame of the source,
+    //  frame number index has index + 1, anything else means the slot was reused since
+    uint64_t sequence;
+    // CLOCK_MONOTONIC ns, capture is when the newest sample was captured, 0 for files, publish when it got here
+    int64_t capture_ns;
+    int64_t publish_ns;
+
+    uint32_t rate;
+    // at most PAV_EXPORT_MAX_CHANNELS, stream_channels is what the stream really has
+    uint32_t n_channels;
+    uint32_t stream_channels;
+    uint32_t n_bands;
+
+    // of each channel's window before the gain control, 0 to 1
+    float rms[PAV_EXPORT_MAX_CHANNELS];
+    // channel c's bands start at bands[c * max_bands]
+    float bands[];
+} pav_export_frame_t;
+
+// --- reader side ---
+
+typedef struct {
+    const uint8_t *map;
+    size_t map_size;
+    const pav_export_header_t *header;
+} pav_export_t;
+
+// name as given to --export-shm, -1 if it isn't there or isn't ours
+static inline int pav_export_open(pav_export_t *ex, const char *name) {
+    *ex = (pav_export_t) {0};
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(pav_export_header_t)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return -1;
+
+    ex->map = map;
+    ex->map_size = st.st_size;
+    ex->header = map;
+
+    if (ex->header->magic != PAV_EXPORT_MAGIC || ex->header->version != PAV_EXPORT_VERSION || ex->header->map_size > ex->map_size) {
+        munmap(map, st.st_size);
+        *ex = (pav_export_t) {0};
+        return -1;
+    }
+
+    return 0;
+}
+
+static inline void pav_export_close(pav_export_t *ex) {
+    munmap((void *) ex->map, ex->map_size);
+}
+
+static inline const pav_export_ring_t *pav_export_ring(const pav_export_t *ex, uint32_t source) {
+    return (const pav_export_ring_t *) (ex->map + ex->header->rings_offset + source * ex->header->ring_size);
+}
+
+// frames the writer has put out for source so far, follow it to read every frame
+static inline uint64_t pav_export_written(const pav_export_t *ex, uint32_t source) {
+    return atomic_load_explicit(&pav_export_ring(ex, source)->written, memory_order_acquire);
+}
+
+// where frame number index (0 based, below pav_export_written) is or was
+static inline const pav_export_frame_t *pav_export_slot(const pav_export_t *ex, uint32_t source, uint64_t index) {
+    const uint8_t *ring = (const uint8_t *) pav_export_ring(ex, source);
+
+    return (const pav_export_frame_t *) (ring + PAV_EXPORT_SLOTS_OFFSET + (index % ex->header->n_slots) * ex->header->slot_size);
+}
+
+// start of a zero copy read, false while the writer is in the slot, pass *lock to pav_export_read_end
+static inline bool pav_export_read_begin(const pav_export_frame_t *frame, uint32_t *lock) {
+    *lock = atomic_load_explicit(&frame->lock, memory_order_acquire);
+
+    return (*lock & 1) == 0;
+}
+
+// true if nothing read from the frame since pav_export_read_begin was overwritten meanwhile
+static inline bool pav_export_read_end(const pav_export_frame_t *frame, uint32_t lock) {
+    atomic_thread_fence(memory_order_acquire);
+
+    return atomic_load_explicit(&frame->lock, memory_order_relaxed) == lock;
+}
+
+// copies the newest frame of source into dst, which needs header->slot_size bytes,
+//  false if there isn't one yet or the writer kept getting in the way
+static inline bool pav_export_read_latest(const pav_export_t *ex, uint32_t source, pav_export_frame_t *dst) {
+    for (int attempt = 0; attempt < 16; attempt++) {
+        uint64_t written = pav_export_written(ex, source);
+        if (written == 0)
+            return false;
+
+        const pav_export_frame_t *frame = pav_export_slot(ex, source, written - 1);
+
+        uint32_t lock;
+        if (!pav_export_read_begin(frame, &lock))
+            continue;
+
+        memcpy(dst, frame, ex->header->slot_size);
+
+        if (pav_export_read_end(frame, lock))
+            return true;
+    }
+
+    return false;
+}
+
+#endif // __PAV_EXPORT
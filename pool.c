@@ -0,0 +1,108 @@
+#include<stdlib.h>
+#include<stdint.h>
+#include<stdbool.h>
+#include<pthread.h>
+#include<semaphore.h>
+#include<stdatomic.h>
+
+#include "dsp.h"
+
+// fork-join worker pool for the per channel stages
+//  the helpers are started once and park on a semaphore between runs, pool_run hands out
+//  task indices from an atomic counter, works on them itself too, and returns once all are done,
+//  so nothing is allocated or created per window
+
+static void pool_work(pool_t *pool, size_t worker) {
+    size_t task;
+    while ((task = atomic_fetch_add_explicit(&pool->next, 1, memory_order_relaxed)) < pool->n_tasks)
+        pool->fn(pool->arg, task, worker);
+}
+
+typedef struct {
+    pool_t *pool;
+    size_t worker;
+} pool_thread_arg_t;
+
+static void *pool_thread_init(void *_arg) {
+    pool_thread_arg_t *arg = _arg;
+    pool_t *pool = arg->pool;
+    size_t worker = arg->worker;
+    free(arg);
+
+    while (true) {
+        sem_wait(&pool->start);
+
+        if (atomic_load(&pool->quit))
+            break;
+
+        pool_work(pool, worker);
+        sem_post(&pool->done);
+    }
+
+    return NULL;
+}
+
+// n_threads helpers on top of the caller, 0 runs everything on the caller
+void pool_init(pool_t *pool, size_t n_threads) {
+    *pool = (pool_t) {
+        .threads = malloc(MAX(n_threads, 1) * sizeof(pthread_t)),
+    };
+
+    sem_init(&pool->start, 0, 0);
+    sem_init(&pool->done, 0, 0);
+    atomic_init(&pool->next, 0);
+    atomic_init(&pool->quit, false);
+
+    for (size_t i = 0; i < n_threads; i++) {
+        pool_thread_arg_t *arg = malloc(sizeof(*arg));
+        *arg = (pool_thread_arg_t) { pool, i + 1 };
+
+        if (pthread_create(&pool->threads[i], NULL, pool_thread_init, arg) != 0) {
+            free(arg);
+            break;
+        }
+
+        pool->n_threads++;
+    }
+}
+
+void pool_free(pool_t *pool) {
+    atomic_store(&pool->quit, true);
+
+    for (size_t i = 0; i < pool->n_threads; i++)
+        sem_post(&pool->start);
+
+    for (size_t i = 0; i < pool->n_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    sem_destroy(&pool->start);
+    sem_destroy(&pool->done);
+    free(pool->threads);
+}
+
+// calls fn(arg, task, worker) for every task in [0, n_tasks), worker is below pool->n_threads + 1
+//  only one thread may call this at a time
+void pool_run(pool_t *pool, pool_fn fn, void *arg, size_t n_tasks) {
+    size_t helpers = MIN(pool->n_threads, n_tasks > 0 ? n_tasks - 1 : 0);
+
+    if (helpers == 0) {
+        for (size_t i = 0; i < n_tasks; i++)
+            fn(arg, i, 0);
+
+        return;
+    }
+
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->n_tasks = n_tasks;
+    // the semaphores order these writes before the helpers read them
+    atomic_store_explicit(&pool->next, 0, memory_order_relaxed);
+
+    for (size_t i = 0; i < helpers; i++)
+        sem_post(&pool->start);
+
+    pool_work(pool, 0);
+
+    for (size_t i = 0; i < helpers; i++)
+        sem_wait(&pool->done);
+}
@@ -0,0 +1,115 @@
+#include<stddef.h>
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+
+#ifdef __SSE2__
+#include<immintrin.h>
+#endif
+
+#include "dsp.h"
+
+// reductions feeding the renderer, kept free of Raylib so bench.c can time them
+//  Vector2 is Raylib's, bench.c brings a layout compatible stand-in
+
+void merge_channels(channel_details_t *all_details, channel_details_t *dst, size_t n_samples, size_t n_bands, size_t n_channels) {
+    for (size_t i = 0; i < n_samples; i++) {
+        float sum = 0;
+
+        for (size_t j = 0; j < n_channels; j++)
+           sum += all_details[j].samples[i];
+
+        dst->samples[i] = sum / n_channels;
+    }
+
+    for (size_t i = 0; i < n_bands; i++) {
+        float sum = 0;
+
+        for (size_t j = 0; j < n_channels; j++)
+           sum += all_details[j].bands[i];
+
+        dst->bands[i] = sum / n_channels;
+    }
+}
+
+void fill_vector_from_samples(float *samples, size_t n_samples, Vector2 *coords, float centerline, int padding, float scale, float sample_chunk) {
+    for (size_t i = 0; i < n_samples; i++) {
+        coords[i].x = padding + sample_chunk * (i + 1);
+        coords[i].y = centerline - (samples[i] * scale);
+    }
+}
+
+// min/max of each column's samples, plus the last sample of the column before it
+//  so neighbouring columns always connect
+//  gcc won't vectorise float min/max reductions without -ffast-math, so sse2 (always there on x86_64) is spelled out
+void decimate_min_max(float *samples, size_t n_samples, float *dst_min, float *dst_max, size_t columns) {
+    for (size_t i = 0; i < columns; i++) {
+        size_t start = i * n_samples / columns;
+        size_t end = (i + 1) * n_samples / columns;
+
+        float lo = samples[start > 0 ? start - 1 : 0];
+        float hi = lo;
+        size_t j = start;
+
+#ifdef __SSE2__
+        __m128 lo4 = _mm_set1_ps(lo);
+        __m128 hi4 = lo4;
+        for (; j + 4 <= end; j += 4) {
+            __m128 x = _mm_loadu_ps(samples + j);
+            lo4 = _mm_min_ps(lo4, x);
+            hi4 = _mm_max_ps(hi4, x);
+        }
+
+        float lanes_lo[4];
+        float lanes_hi[4];
+        _mm_storeu_ps(lanes_lo, lo4);
+        _mm_storeu_ps(lanes_hi, hi4);
+        for (size_t k = 0; k < 4; k++) {
+            lo = MIN(lo, lanes_lo[k]);
+            hi = MAX(hi, lanes_hi[k]);
+        }
+#endif
+
+        for (; j < end; j++) {
+            lo = MIN(lo, samples[j]);
+            hi = MAX(hi, samples[j]);
+        }
+
+        dst_min[i] = lo;
+        dst_max[i] = hi;
+    }
+}
+
+// one spectrogram row, every band averaged over the channels and mapped to 0-255 on a dB scale
+//  covering range_db below peak, which follows the loudest band up at once and decays by decay per row
+void spectrogram_row(channel_details_t *all_details, size_t n_channels, size_t n_bands, uint8_t *dst, float *peak, float decay, float range_db) {
+    float loudest = 0;
+    for (size_t i = 0; i < n_bands; i++) {
+        float sum = 0;
+
+        for (size_t j = 0; j < n_channels; j++)
+           sum += all_details[j].bands[i];
+
+        loudest = fmaxf(loudest, sum / n_channels);
+    }
+
+    *peak = fmaxf(*peak * decay, loudest);
+    if (*peak <= 0) {
+        memset(dst, 0, n_bands);
+        return;
+    }
+
+    // 255 at the peak, 0 at range_db below it, log10 of the ratio instead of a divide per band
+    float scale = 255 * 20 / range_db;
+    float offset = 255 - scale * log10f(*peak);
+
+    for (size_t i = 0; i < n_bands; i++) {
+        float sum = 0;
+
+        for (size_t j = 0; j < n_channels; j++)
+           sum += all_details[j].bands[i];
+
+        float level = sum > 0 ? offset + scale * log10f(sum / n_channels) : 0;
+        dst[i] = fminf(fmaxf(level, 0), 255);
+    }
+}
@@ -0,0 +1,126 @@
+#include<stdlib.h>
+#include<stdint.h>
+#include<stdbool.h>
+#include<string.h>
+#include<stdatomic.h>
+#include<assert.h>
+
+#include "dsp.h"
+
+// wait-free single producer, single consumer byte ring
+//  the producer stages data past head with spsc_ring_put and makes it visible
+//  with one release store in spsc_ring_commit, so a record is never seen half written
+
+// saturates at the largest power of two a size_t holds
+static size_t next_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n && p < SIZE_MAX / 2 + 1)
+        p <<= 1;
+
+    return p;
+}
+
+void spsc_ring_init(spsc_ring_t *ring, size_t capacity) {
+    capacity = next_pow2(capacity);
+
+    ring->data = malloc(capacity);
+    ring->capacity = capacity;
+    ring->mask = capacity - 1;
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->commits, 0);
+    atomic_init(&ring->overruns, 0);
+    atomic_init(&ring->high_water, 0);
+}
+
+void spsc_ring_free(spsc_ring_t *ring) {
+    free(ring->data);
+    ring->data = NULL;
+}
+
+static void ring_copy_in(spsc_ring_t *ring, size_t pos, const void *src, size_t bytes) {
+    size_t offset = pos & ring->mask;
+    size_t first = MIN(bytes, ring->capacity - offset);
+
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, (const uint8_t *) src + first, bytes - first);
+}
+
+static void ring_copy_out(spsc_ring_t *ring, size_t pos, void *dst, size_t bytes) {
+    size_t offset = pos & ring->mask;
+    size_t first = MIN(bytes, ring->capacity - offset);
+
+    memcpy(dst, ring->data + offset, first);
+    memcpy((uint8_t *) dst + first, ring->data, bytes - first);
+}
+
+// producer side
+
+size_t spsc_ring_writable(spsc_ring_t *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    return ring->capacity - (head - tail);
+}
+
+// stage bytes at head + offset, invisible to the consumer until committed
+void spsc_ring_put(spsc_ring_t *ring, size_t offset, const void *src, size_t bytes) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    ring_copy_in(ring, head + offset, src, bytes);
+}
+
+void spsc_ring_commit(spsc_ring_t *ring, size_t bytes) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed) + bytes;
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+
+    size_t used = head - atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (used > atomic_load_explicit(&ring->high_water, memory_order_relaxed))
+        atomic_store_explicit(&ring->high_water, used, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&ring->commits, 1, memory_order_relaxed);
+}
+
+// the producer gave up on a write because there was no space
+void spsc_ring_overrun(spsc_ring_t *ring) {
+    atomic_fetch_add_explicit(&ring->overruns, 1, memory_order_relaxed);
+}
+
+// consumer side
+
+size_t spsc_ring_readable(spsc_ring_t *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    return head - tail;
+}
+
+void spsc_ring_get(spsc_ring_t *ring, size_t offset, void *dst, size_t bytes) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    ring_copy_out(ring, tail + offset, dst, bytes);
+}
+
+// reads in place, where tail + offset is in the ring, *contiguous is what's left of it up to the end, may be NULL
+const uint8_t *spsc_ring_peek(spsc_ring_t *ring, size_t offset, size_t *contiguous) {
+    size_t pos = (atomic_load_explicit(&ring->tail, memory_order_relaxed) + offset) & ring->mask;
+
+    if (contiguous != NULL)
+        *contiguous = ring->capacity - pos;
+
+    return ring->data + pos;
+}
+
+void spsc_ring_consume(spsc_ring_t *ring, size_t bytes) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + bytes, memory_order_release);
+}
+
+// any thread, only approximate while the ring is in use
+size_t spsc_ring_used(spsc_ring_t *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    return head - tail;
+}
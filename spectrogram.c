@@ -0,0 +1,117 @@
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<raylib.h>
+
+#include "util.h"
+
+// scrolling spectrogram
+//  the texture is a ring of --history rows, one byte per band, every frame the analysis publishes
+//  is uploaded as a single row with UpdateTextureRec and scrolling only moves where drawing starts
+//  reading, the texture repeats vertically, so a frame costs the same however long the history is,
+//  the bytes are coloured through a 256 entry lookup texture by a plain GL 3.3 shader, llvmpipe runs it too
+
+// quiet bands fade into the transparent background, the lookup is read at texel centres
+static const char *spectrogram_fs =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform sampler2D lut;\n"
+    "out vec4 finalColor;\n"
+    "void main() {\n"
+    "    float level = texture(texture0, fragTexCoord).r;\n"
+    "    vec3 color = texture(lut, vec2((level * 255.0 + 0.5) / 256.0, 0.5)).rgb;\n"
+    "    finalColor = vec4(color, min(level * 2.0, 1.0)) * fragColor;\n"
+    "}\n";
+
+typedef struct {
+    Texture2D texture;
+    Texture2D lut;
+    Shader shader;
+    int lut_loc;
+
+    int rows;
+    // row the newest frame went into, rows are written upwards so reading down from here goes back in time
+    int head;
+    // of the newest row, the texture is max_bands wide
+    uint32_t n_bands;
+
+    uint8_t *staging;
+} spectrogram_t;
+
+// has to run on the thread that owns the window
+void spectrogram_init(spectrogram_t *sg, size_t max_bands, int rows, const palette_t *palette) {
+    *sg = (spectrogram_t) {
+        .rows = MAX(rows, 1),
+        .staging = malloc(max_bands),
+    };
+
+    Image image = {
+        .data = calloc((size_t) max_bands * sg->rows, 1),
+        .width = max_bands,
+        .height = sg->rows,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE,
+    };
+
+    sg->texture = LoadTextureFromImage(image);
+    SetTextureWrap(sg->texture, TEXTURE_WRAP_REPEAT);
+    free(image.data);
+
+    // one entry per level, the bytes index it directly
+    Image lut_image = {
+        .data = (void *) palette->colors,
+        .width = PALETTE_SIZE,
+        .height = 1,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+
+    sg->lut = LoadTextureFromImage(lut_image);
+
+    // raylib falls back to its default shader if this doesn't compile, that draws the levels in grey
+    sg->shader = LoadShaderFromMemory(NULL, spectrogram_fs);
+    sg->lut_loc = GetShaderLocation(sg->shader, "lut");
+}
+
+void spectrogram_free(spectrogram_t *sg) {
+    UnloadTexture(sg->texture);
+    UnloadTexture(sg->lut);
+    UnloadShader(sg->shader);
+    free(sg->staging);
+}
+
+// uploads every row queued by spectrogram_push, one UpdateTextureRec each, returns whether there were any
+bool spectrogram_update(spectrogram_t *sg, spsc_ring_t *rows) {
+    bool updated = false;
+
+    uint32_t n_bands;
+    while (spsc_ring_readable(rows) >= sizeof(n_bands)) {
+        spsc_ring_get(rows, 0, &n_bands, sizeof(n_bands));
+        spsc_ring_get(rows, sizeof(n_bands), sg->staging, n_bands);
+        spsc_ring_consume(rows, sizeof(n_bands) + n_bands);
+
+        sg->head = (sg->head + sg->rows - 1) % sg->rows;
+        sg->n_bands = n_bands;
+
+        UpdateTextureRec(sg->texture, (Rectangle) { 0, sg->head, n_bands, 1 }, sg->staging);
+        updated = true;
+    }
+
+    return updated;
+}
+
+// newest row at the top
+void spectrogram_draw(spectrogram_t *sg, float x, float y, float width, float height) {
+    if (sg->n_bands == 0)
+        return;
+
+    // runs past the bottom of the texture and wraps around to its top
+    Rectangle source = { 0, sg->head, sg->n_bands, sg->rows };
+
+    BeginShaderMode(sg->shader);
+    SetShaderValueTexture(sg->shader, sg->lut_loc, sg->lut);
+    DrawTexturePro(sg->texture, source, (Rectangle) { x, y, width, height }, (Vector2) { 0, 0 }, 0, WHITE);
+    EndShaderMode();
+}
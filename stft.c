@@ -0,0 +1,138 @@
+#include<stdlib.h>
+#include<stdint.h>
+#include<stdbool.h>
+#include<string.h>
+#include<math.h>
+#include<assert.h>
+
+#include "dsp.h"
+
+// sliding window stft stage
+//  incoming audio is appended to a per-channel history ring, and every hop frames
+//  the newest size frames are handed out as one analysis window, so the fft size,
+//  and with it the frequency resolution, doesn't depend on the PipeWire quantum
+
+#define STFT_MAX_SIZE 65536
+
+// n_scratch is how many threads may call stft_transform at the same time
+void stft_init(stft_t *stft, size_t size, size_t hop, size_t n_scratch) {
+    // the fft only does powers of two, the upper bound keeps the arena sane
+    size = MIN(MAX(next_pow2(size), 2), STFT_MAX_SIZE);
+    hop = MAX(MIN(hop, size), 1);
+    n_scratch = MAX(n_scratch, 1);
+
+    *stft = (stft_t) {
+        .size = size,
+        .hop = hop,
+        .plan = rfft_plan_new(size),
+        .window = malloc(size * sizeof(float)),
+        .n_scratch = n_scratch,
+    };
+
+    size_t n_bins = rfft_bins(stft->plan);
+    size_t scratch = n_scratch * (sizeof(stft_scratch_t) + (size * 2 + n_bins * 2) * sizeof(float));
+    arena_init(&stft->arena, arena_size_for(scratch, 1 + n_scratch * 5));
+
+    // for stft_transform, never re-sliced
+    stft->scratch = arena_alloc(&stft->arena, n_scratch * sizeof(stft_scratch_t));
+    for (size_t i = 0; i < n_scratch; i++) {
+        stft->scratch[i] = (stft_scratch_t) {
+            .windowed = arena_alloc(&stft->arena, size * sizeof(float)),
+            .real = arena_alloc(&stft->arena, n_bins * sizeof(float)),
+            .imag = arena_alloc(&stft->arena, n_bins * sizeof(float)),
+            .z_real = arena_alloc(&stft->arena, size / 2 * sizeof(float)),
+            .z_imag = arena_alloc(&stft->arena, size / 2 * sizeof(float)),
+        };
+    }
+
+    // hann, scaled to a mean of 1 so magnitudes stay on the same scale as unwindowed input
+    double sum = 0;
+    for (size_t i = 0; i < size; i++) {
+        stft->window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / size);
+        sum += stft->window[i];
+    }
+
+    for (size_t i = 0; i < size; i++)
+        stft->window[i] *= size / sum;
+}
+
+void stft_free(stft_t *stft) {
+    rfft_plan_free(stft->plan);
+    free(stft->window);
+    arena_free(&stft->arena);
+    arena_free(&stft->history_arena);
+
+    *stft = (stft_t) {0};
+}
+
+// drops all history, needed whenever the channel layout or rate changes
+void stft_reset(stft_t *stft, size_t n_channels, uint32_t rate) {
+    assert(n_channels <= MAX_CHANNELS);
+
+    // sized for the widest layout so far, resets only happen on the analysis thread between windows
+    size_t bytes = n_channels * stft->size * sizeof(float);
+    if (bytes > stft->history_arena.capacity) {
+        arena_free(&stft->history_arena);
+        arena_init(&stft->history_arena, bytes);
+    }
+
+    // comes back zeroed
+    arena_reset(&stft->history_arena);
+    stft->history = arena_alloc(&stft->history_arena, bytes);
+
+    stft->n_channels = n_channels;
+    stft->rate = rate;
+    stft->cursor = 0;
+    stft->pending = 0;
+}
+
+// appends frames [offset, offset + n_frames) of view, converting as it goes, but never past the next window,
+//  returns how many were taken
+size_t stft_feed(stft_t *stft, const sample_view_t *view, size_t offset, size_t n_frames) {
+    size_t n = MIN(n_frames, stft->hop - stft->pending);
+    // up to the end of the history ring, the rest wraps around to its start
+    size_t first = MIN(n, stft->size - stft->cursor);
+
+    size_t bytes = sample_size(view->format);
+    for (size_t j = 0; j < stft->n_channels; j++) {
+        const uint8_t *src = (const uint8_t *) view->channels[j] + offset * view->stride * bytes;
+        float *history = stft->history + j * stft->size;
+
+        convert_samples(history + stft->cursor, src, view->format, view->stride, first);
+        convert_samples(history, src + first * view->stride * bytes, view->format, view->stride, n - first);
+    }
+
+    stft->cursor = (stft->cursor + n) & (stft->size - 1);
+    stft->pending += n;
+
+    return n;
+}
+
+bool stft_ready(stft_t *stft) {
+    return stft->pending == stft->hop;
+}
+
+// copies the newest size frames of one channel, oldest first
+void stft_window(stft_t *stft, size_t channel, float *dst) {
+    const float *history = stft->history + channel * stft->size;
+    size_t first = stft->size - stft->cursor;
+
+    memcpy(dst, history + stft->cursor, first * sizeof(float));
+    memcpy(dst + first, history, stft->cursor * sizeof(float));
+}
+
+void stft_advance(stft_t *stft) {
+    stft->pending = 0;
+}
+
+// writes rfft_bins(stft->plan) magnitudes, samples aren't modified
+//  threads running this at the same time each need their own scratch index
+void stft_transform(stft_t *stft, size_t scratch, const float *samples, float *dst) {
+    stft_scratch_t *s = &stft->scratch[scratch];
+
+    for (size_t i = 0; i < stft->size; i++)
+        s->windowed[i] = samples[i] * stft->window[i];
+
+    fft_samples_scratch(stft->plan, s->windowed, s->real, s->imag, s->z_real, s->z_imag);
+    fft_magnitudes(stft->plan, s->real, s->imag, dst, rfft_bins(stft->plan));
+}
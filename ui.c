@@ -1,110 +1,135 @@
 #include<stdio.h>
+#include<stdlib.h>
 #include<stdint.h>
 #include<stddef.h>
 #include<math.h>
 #include<time.h>
 #include<raylib.h>
 #include<assert.h>
+#include<errno.h>
+#include<semaphore.h>
 
 #include "util.h"
-#include "spotify_dbus.c"
-
-#define COLOR_PROGRESSION(ctx) (((ctx)->opts.flip_colors) ? color_progression_alt : color_progression)
-#define COLOR_PROGRESSION_ALT(ctx) (((ctx)->opts.flip_colors) ? color_progression : color_progression_alt)
+#include "mpris.c"
+#include "palette.c"
+#include "overlay.c"
+#include "spectrogram.c"
+#include "bars.c"
 
 int S_WIDTH = -1;
 int S_HEIGHT = -1;
 
-void avg_reduce_stream(float *src, size_t src_size, float *dst, size_t dst_size, float scale) {
-    // reduce src chunks to dst chunks
-    size_t chunk = src_size / dst_size;
+// what the current frame handed to raylib, it merges consecutive shapes into batches on its own,
+//  so these are the submissions --renderer shader cuts down, reported through the metrics
+typedef struct {
+    uint64_t draws;
+    uint64_t vertices;
+} draw_counts_t;
 
-    for (size_t i = 0; i < dst_size; i++) {
-        float sum = 0;
-        for (size_t j = i * chunk; j < (i + 1) * chunk; j++)
-            sum += src[j];
+draw_counts_t DRAW_COUNTS = {0};
 
-        dst[i] = (sum / chunk) * scale;
-    }
+void count_draw(uint64_t vertices) {
+    DRAW_COUNTS.draws++;
+    DRAW_COUNTS.vertices += vertices;
 }
 
-void merge_channels(channel_details_t *all_details, channel_details_t *dst, size_t n_samples, size_t n_channels) {
-    for (size_t i = 0; i < n_samples; i++) {
-        float sum = 0;
-        float sum_fft = 0;
-
-        for (size_t j = 0; j < n_channels; j++) {
-           sum += all_details[j].samples[i];
-           sum_fft += all_details[j].fft[i];
-        }
-
-        dst->samples[i] = sum / n_channels;
-        dst->fft[i] = sum_fft / n_channels;
-    }
+void draw_rectangle(Vector2 pos, Vector2 size, Color color) {
+    DrawRectangleV(pos, size, color);
+    count_draw(4);
 }
 
-void fill_vector_from_samples(float *samples, size_t n_samples, Vector2 *coords, float centerline, int padding, float scale, float sample_chunk) {
-    for (size_t i = 0; i < n_samples; i++) {
-        coords[i].x = padding + sample_chunk * (i + 1);
-        coords[i].y = centerline - (samples[i] * scale);
+// a waveform reduced to one min/max pair per pixel column
+typedef struct {
+    float *min;
+    float *max;
+    // looked up with the rest, colours only change when the frame does
+    float *levels;
+    Color *colors;
+    float peak;
+    size_t columns;
+} waveform_t;
+
+// owned by the render thread, only rebuilt when a new frame comes in
+typedef struct {
+    uint64_t sequence;
+
+    // channels merged for the mono view
+    float *samples;
+    float *bands;
+
+    waveform_t waves[2];
+} render_cache_t;
+
+void waveform_update(waveform_t *wave, float *samples, size_t n_samples, size_t max_columns, const palette_t *palette) {
+    wave->columns = MIN(n_samples, max_columns);
+    decimate_min_max(samples, n_samples, wave->min, wave->max, wave->columns);
+
+    wave->peak = 0;
+    for (size_t i = 0; i < wave->columns; i++) {
+        wave->levels[i] = MAX(fabsf(wave->min[i]), fabsf(wave->max[i]));
+        wave->peak = MAX(wave->peak, wave->levels[i]);
     }
+
+    palette_lookup(palette, wave->levels, wave->peak > 0 ? 1 / wave->peak : 0, wave->colors, wave->columns);
 }
 
-void render_samples(float *samples, size_t n_samples, float centerline, Color (*color_progression_fn)(float)) {
+// one rectangle per column, at most S_WIDTH of them, all batched by raylib into a few draw calls
+void render_samples(waveform_t *wave, float centerline) {
     const int PADDING = 0;
     const int SCALE = 40;
-
-    float sample_max = 0;
-    for (size_t i = 0; i < n_samples; i++)
-        sample_max = MAX(sample_max, fabsf(samples[i]));
-
-    Vector2 coords[n_samples];
+    const float THICKNESS = 2.0f;
 
     int draw_width = S_WIDTH - PADDING * 2;
+    float column_width = (float) draw_width / wave->columns;
 
-    fill_vector_from_samples(samples, n_samples, coords, centerline, PADDING, SCALE, (float) draw_width / n_samples);
-
-    // peg first and last point to the edge, otherwise there will be a small gap at either side
-    coords[0].x = PADDING;
-    coords[n_samples - 1].x = S_WIDTH - PADDING;
+    for (size_t i = 0; i < wave->columns; i++) {
+        float top = centerline - wave->max[i] * SCALE;
+        float bottom = centerline - wave->min[i] * SCALE;
 
-    for (size_t i = 0; i < n_samples - 1; i += 2) {
-        Vector2 start = coords[i];
-        Vector2 end = coords[i + 1];
-
-        Color color = color_progression_fn(fabsf(samples[i + 1]) / sample_max);
-        DrawLineEx(start, end, 2.0f, color);
-
-        if (i + 2 < n_samples) {
-            Vector2 start2 = coords[i + 2];
-            DrawLineEx(end, start2, 2.0f, color);
-        }
+        Vector2 pos = { PADDING + column_width * i, top - THICKNESS / 2 };
+        Vector2 size = { MAX(column_width, 1), bottom - top + THICKNESS };
+        draw_rectangle(pos, size, wave->colors[i]);
     }
 }
 
-void prepare_fft_render(ctx_t *ctx, Vector2 *dst, float *magnitudes) {
-    size_t freq_visible = MIN(256, ctx->relevant_fft_bins);
-    float fft_visible[freq_visible];
+// bands are already mapped by the analysis thread, see bands.c
+void prepare_fft_render(analysis_frame_t *frame, Vector2 *dst, float *bands) {
+    fill_vector_from_samples(bands, frame->n_bands, dst, S_HEIGHT - 1, 0, 0.4, (float) S_WIDTH / frame->n_bands);
+}
 
-    avg_reduce_stream(magnitudes, ctx->relevant_fft_bins, fft_visible, freq_visible, 0.4);
+// bars is NULL for --renderer immediate, otherwise the whole panel is one bars_draw
+void render_mono_channel(ctx_t *ctx, analysis_frame_t *frame, render_cache_t *cache, arena_t *scratch, bars_t *bars) {
+    float *bands = cache->bands;
 
-    fill_vector_from_samples(fft_visible, freq_visible, dst, S_HEIGHT - 1, 0, 1, (float) S_WIDTH / freq_visible);
-}
+    if (cache->sequence != frame->sequence) {
+        channel_details_t _curr = { .samples = cache->samples, .bands = cache->bands };
+        merge_channels(frame->details, &_curr, frame->n_samples, frame->n_bands, frame->n_channels);
 
-void render_mono_channel(ctx_t *ctx) {
-    float samples[ctx->n_samples];
-    float fft[ctx->n_samples];
-    channel_details_t _curr = { .samples = samples, .fft = fft };
+        waveform_update(&cache->waves[0], cache->samples, frame->n_samples, S_WIDTH, &ctx->palettes[0]);
+        cache->sequence = frame->sequence;
+    }
+
+    if (bars != NULL) {
+        waveform_t *wave = &cache->waves[0];
+
+        bars_reset(bars);
+        bars_wave(bars, 0, wave->min, wave->max, wave->columns, wave->peak, S_HEIGHT / 2);
+        bars_spectrum(bars, 0, bands, frame->n_bands, 0.4);
+        bars_draw(bars, S_WIDTH, S_HEIGHT, ctx->opts.mirror ? 0 : -1, false, BLUE);
+        count_draw(4);
+        return;
+    }
 
-    merge_channels(ctx->details, &_curr, ctx->n_samples, ctx->n_channels);
+    render_samples(&cache->waves[0], S_HEIGHT / 2);
 
-    render_samples(samples, ctx->n_samples, S_HEIGHT / 2, COLOR_PROGRESSION(ctx));
+    if (frame->n_bands == 0)
+        return;
 
     // rendering fft
-    Vector2 fft_coords[ctx->relevant_fft_bins];
-    prepare_fft_render(ctx, fft_coords, fft);
+    Vector2 *fft_coords = arena_alloc(scratch, frame->n_bands * sizeof(*fft_coords));
+    prepare_fft_render(frame, fft_coords, bands);
 
-    size_t freq_visible = MIN(256, ctx->relevant_fft_bins);
+    size_t freq_visible = frame->n_bands;
     float freq_draw_width = (float) (S_WIDTH / freq_visible);
 
     for (size_t i = 0; i < freq_visible; i++) {
@@ -115,7 +140,7 @@ void render_mono_channel(ctx_t *ctx) {
 
         Vector2 pos = { point.x - x_shift, point.y };
         Vector2 size = { freq_draw_width, S_HEIGHT - point.y };
-        DrawRectangleV(pos, size, BLUE);
+        draw_rectangle(pos, size, BLUE);
     }
 
     if (ctx->opts.mirror) {
@@ -124,27 +149,50 @@ void render_mono_channel(ctx_t *ctx) {
 
             Vector2 pos = { S_WIDTH - point.x, point.y };
             Vector2 size = { freq_draw_width, S_HEIGHT - point.y };
-            DrawRectangleV(pos, size, BLUE);
+            draw_rectangle(pos, size, BLUE);
         }
     }
 }
 
 
-void render_two_channels(ctx_t *ctx) {
-    assert(ctx->n_channels == 2);
+void render_two_channels(ctx_t *ctx, analysis_frame_t *frame, render_cache_t *cache, arena_t *scratch, bars_t *bars) {
+    assert(frame->n_channels == 2);
+
+    if (cache->sequence != frame->sequence) {
+        waveform_update(&cache->waves[0], frame->details[0].samples, frame->n_samples, S_WIDTH, &ctx->palettes[0]);
+        waveform_update(&cache->waves[1], frame->details[1].samples, frame->n_samples, S_WIDTH, &ctx->palettes[1]);
+        cache->sequence = frame->sequence;
+    }
 
     size_t centerline_offset = ctx->opts.split_waves ? 200 : 0;
-    render_samples(ctx->details[0].samples, ctx->n_samples, S_HEIGHT / 2 - centerline_offset, COLOR_PROGRESSION(ctx));
-    render_samples(ctx->details[1].samples, ctx->n_samples, S_HEIGHT / 2 + centerline_offset, COLOR_PROGRESSION_ALT(ctx));
+
+    if (bars != NULL) {
+        waveform_t *waves = cache->waves;
+
+        bars_reset(bars);
+        bars_wave(bars, 0, waves[0].min, waves[0].max, waves[0].columns, waves[0].peak, S_HEIGHT / 2 - centerline_offset);
+        bars_wave(bars, 1, waves[1].min, waves[1].max, waves[1].columns, waves[1].peak, S_HEIGHT / 2 + centerline_offset);
+        bars_spectrum(bars, 0, frame->details[0].bands, frame->n_bands, 0.4);
+        bars_spectrum(bars, 1, frame->details[1].bands, frame->n_bands, 0.4);
+        bars_draw(bars, S_WIDTH, S_HEIGHT, 1, false, BLUE);
+        count_draw(4);
+        return;
+    }
+
+    render_samples(&cache->waves[0], S_HEIGHT / 2 - centerline_offset);
+    render_samples(&cache->waves[1], S_HEIGHT / 2 + centerline_offset);
+
+    if (frame->n_bands == 0)
+        return;
 
     // rendering fft
-    Vector2 fft_coords_r[ctx->relevant_fft_bins];
-    Vector2 fft_coords_l[ctx->relevant_fft_bins];
+    Vector2 *fft_coords_r = arena_alloc(scratch, frame->n_bands * sizeof(*fft_coords_r));
+    Vector2 *fft_coords_l = arena_alloc(scratch, frame->n_bands * sizeof(*fft_coords_l));
 
-    prepare_fft_render(ctx, fft_coords_r, ctx->details[0].fft);
-    prepare_fft_render(ctx, fft_coords_l, ctx->details[1].fft);
+    prepare_fft_render(frame, fft_coords_r, frame->details[0].bands);
+    prepare_fft_render(frame, fft_coords_l, frame->details[1].bands);
 
-    size_t freq_visible = MIN(256, ctx->relevant_fft_bins);
+    size_t freq_visible = frame->n_bands;
     float freq_draw_width = (float) (S_WIDTH / freq_visible);
 
     for (size_t i = 0; i < freq_visible; i++) {
@@ -155,7 +203,7 @@ void render_two_channels(ctx_t *ctx) {
 
         Vector2 pos = { point.x - x_shift, point.y };
         Vector2 size = { freq_draw_width, S_HEIGHT - point.y };
-        DrawRectangleV(pos, size, BLUE);
+        draw_rectangle(pos, size, BLUE);
     }
 
     for (size_t i = 0; i < freq_visible; i++) {
@@ -163,28 +211,65 @@ void render_two_channels(ctx_t *ctx) {
 
         Vector2 pos = { S_WIDTH - point.x, point.y };
         Vector2 size = { freq_draw_width, S_HEIGHT - point.y };
-        DrawRectangleV(pos, size, BLUE);
+        draw_rectangle(pos, size, BLUE);
     }
 }
 
-void load_font(ctx_t *ctx, Font *font) {
-    if (ctx->opts.font == NULL)
+// every channel's spectrum in a strip of its own, top to bottom in stream order
+void render_all_channels(ctx_t *ctx, analysis_frame_t *frame, arena_t *scratch, bars_t *bars) {
+    if (frame->n_bands == 0)
         return;
 
-    // Latin Extended-A
-    const size_t l_ex_a_count =  0x017F - 0x0020 + 1;
-    // Cyrillic
-    const size_t c_count = 0x04FF - 0x0400 + 1;
+    // the strip colours come from the progression's lookup row
+    if (bars != NULL) {
+        bars_reset(bars);
+        for (size_t c = 0; c < frame->n_channels; c++)
+            bars_spectrum(bars, c, frame->details[c].bands, frame->n_bands, 0.4 / frame->n_channels);
 
-    int codepoints[l_ex_a_count + c_count];
+        bars_draw(bars, S_WIDTH, S_HEIGHT, -1, true, BLUE);
+        count_draw(4);
+        return;
+    }
+
+    float strip_height = (float) S_HEIGHT / frame->n_channels;
+    float freq_draw_width = (float) (S_WIDTH / frame->n_bands);
+
+    // reused for every strip
+    Vector2 *fft_coords = arena_alloc(scratch, frame->n_bands * sizeof(*fft_coords));
+
+    for (size_t c = 0; c < frame->n_channels; c++) {
+        float top = strip_height * c;
+        float bottom = top + strip_height - 1;
+        Color color = palette_color(&ctx->palettes[0], frame->n_channels > 1 ? (float) c / (frame->n_channels - 1) : 0);
 
-    for (size_t i = 0; i < l_ex_a_count; i++)
-        codepoints[i] = 0x0020 + i;
+        // same scale as the full height view, shrunk to the strip
+        fill_vector_from_samples(frame->details[c].bands, frame->n_bands, fft_coords, bottom, 0,
+                0.4 / frame->n_channels, (float) S_WIDTH / frame->n_bands);
 
-    for (size_t i = 0; i < c_count; i++)
-        codepoints[i + l_ex_a_count] = 0x0400 + i;
+        for (size_t i = 0; i < frame->n_bands; i++) {
+            Vector2 point = fft_coords[i];
+            float y = MAX(point.y, top);
 
-    *font = LoadFontEx(ctx->opts.font, 128, codepoints, l_ex_a_count + c_count);
+            Vector2 pos = { point.x - freq_draw_width, y };
+            Vector2 size = { freq_draw_width, bottom - y };
+            draw_rectangle(pos, size, color);
+        }
+    }
+}
+
+// until the analysis publishes a frame or timeout_ms passes
+void render_wait(ctx_t *ctx, long timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    deadline.tv_nsec += timeout_ms % 1000 * 1000000;
+    deadline.tv_sec += timeout_ms / 1000 + deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+
+    while (sem_timedwait(&ctx->render_wakeup, &deadline) < 0 && errno == EINTR);
+
+    // frames that came in while the last one was being drawn only need one redraw
+    while (sem_trywait(&ctx->render_wakeup) == 0);
 }
 
 void *draw_thread_init(void *_ctx) {
@@ -205,70 +290,187 @@ void *draw_thread_init(void *_ctx) {
 
     SetWindowSize(S_WIDTH, S_HEIGHT);
 
-    const time_t SPOTIFY_FETCH_INTERVAL = 1;
-    spotify_data_t spotify_data = {0};
-    time_t spotify_last_get = 0;
+    // now playing, filled in by its own thread
+    mpris_t mpris;
+    mpris_start(&mpris);
+
+    overlay_t overlay;
+    overlay_init(&overlay, ctx->opts.font);
+
+    // per panel scratch, reset before every render, at most two sets of fft coords
+    //  every source has the same stft and band sizes
+    source_t *first = &ctx->sources[0];
+    arena_t scratch;
+    arena_init(&scratch, arena_size_for(first->bands.max_bands * 2 * sizeof(Vector2), 2));
+
+    // frames never hold more than stft.size samples and max_bands bands, colours are as big as floats
+    arena_t cache_arena;
+    arena_init(&cache_arena, arena_size_for(ctx->n_sources * (first->stft.size + first->bands.max_bands + 8 * S_WIDTH) * sizeof(float), ctx->n_sources * 10));
+
+    // one per source, nothing is drawn until there's something new to show
+    render_cache_t caches[MAX_SOURCES];
+    uint64_t drawn_sequences[MAX_SOURCES];
+
+    for (size_t i = 0; i < ctx->n_sources; i++) {
+        caches[i] = (render_cache_t) {
+            .sequence = UINT64_MAX,
+            .samples = arena_alloc(&cache_arena, first->stft.size * sizeof(float)),
+            .bands = arena_alloc(&cache_arena, first->bands.max_bands * sizeof(float)),
+        };
+
+        for (size_t j = 0; j < 2; j++) {
+            caches[i].waves[j].min = arena_alloc(&cache_arena, S_WIDTH * sizeof(float));
+            caches[i].waves[j].max = arena_alloc(&cache_arena, S_WIDTH * sizeof(float));
+            caches[i].waves[j].levels = arena_alloc(&cache_arena, S_WIDTH * sizeof(float));
+            caches[i].waves[j].colors = arena_alloc(&cache_arena, S_WIDTH * sizeof(Color));
+        }
+
+        drawn_sequences[i] = UINT64_MAX;
+    }
+
+    // waterfalls, one per source, filled from the rows the analysis queues
+    spectrogram_t spectrograms[MAX_SOURCES];
+    if (ctx->opts.spectrogram) {
+        for (size_t i = 0; i < ctx->n_sources; i++)
+            spectrogram_init(&spectrograms[i], first->bands.max_bands, ctx->opts.history, &ctx->palettes[0]);
+    }
+
+    // one for every panel, they're drawn one after the other and the texture is rewritten in between
+    bars_t bars;
+    bars_t *panel_bars = NULL;
+    if (ctx->opts.renderer == RENDERER_SHADER) {
+        bars_init(&bars, MAX(first->bands.max_bands, (size_t) S_WIDTH), ctx->palettes);
+        panel_bars = &bars;
+    }
+
+    long idle_ms = 1000 / MAX(ctx->opts.idle_fps, 1);
 
-    Font font = {0};
-    load_font(ctx, &font);
+    // sources are stacked top to bottom, each drawn as if the window was only its panel
+    int window_height = S_HEIGHT;
+    int panel_height = window_height / ctx->n_sources;
 
     bool quit = false;
     while(!WindowShouldClose() && !quit) {
         if (IsKeyPressed(KEY_Q))
             quit = true;
 
-        struct timespec render_start;
-        clock_gettime(CLOCK_REALTIME, &render_start);
+        render_wait(ctx, idle_ms);
+
+        // main is about to free the frames
+        if (atomic_load(&ctx->render_quit))
+            break;
+
+        // each stays valid and untouched by the audio thread until its next read
+        analysis_frame_t *frames[MAX_SOURCES];
+        bool new_frames[MAX_SOURCES];
+        bool any_new = false;
+
+        for (size_t i = 0; i < ctx->n_sources; i++) {
+            frames[i] = frame_buffer_read(&ctx->sources[i].frames);
+
+            // a track change redraws the same frame, that doesn't count towards the latency
+            new_frames[i] = frames[i]->sequence != drawn_sequences[i];
+            drawn_sequences[i] = frames[i]->sequence;
+            any_new |= new_frames[i];
+        }
+
+        track_t *track = mpris_read(&mpris);
+
+        // the last frames stay on screen, only input needs looking at
+        if (!any_new && track->sequence == overlay.sequence) {
+            PollInputEvents();
+            continue;
+        }
+
+        int64_t render_start = metrics_now();
+        if (ctx->_last_render != 0)
+            metrics_record(&ctx->metrics, METRIC_FRAME, render_start - ctx->_last_render);
+
+        ctx->_last_render = render_start;
 
         char title[64];
         sprintf(title, "audio visualizer | fps: %d", GetFPS());
         SetWindowTitle(title);
 
+        // re-renders the text only when the track changed, can't happen while drawing
+        overlay_update(&overlay, track);
+
+        if (ctx->opts.spectrogram) {
+            for (size_t i = 0; i < ctx->n_sources; i++)
+                spectrogram_update(&spectrograms[i], &ctx->sources[i].rows);
+        }
+
         BeginDrawing();
 
         ClearBackground(BLANK);
 
-        time_t now = time(NULL);
-        if (now - spotify_last_get >= SPOTIFY_FETCH_INTERVAL) {
-            if (get_spotify_data(&spotify_data) < 0) {
-                spotify_data = (spotify_data_t) {0};
-            }
+        DRAW_COUNTS = (draw_counts_t) {0};
 
-            spotify_last_get = now;
-        }
+        overlay_draw(&overlay, 100, 100);
+        count_draw(overlay.visible ? 4 : 0);
+
+        S_HEIGHT = panel_height;
+
+        for (size_t i = 0; i < ctx->n_sources; i++) {
+            analysis_frame_t *frame = frames[i];
+            if (frame->details == NULL)
+                continue;
+
+            arena_reset(&scratch);
 
-        if (spotify_data.artist != 0) {
-            if (ctx->opts.font != NULL && font.texture.id != 0) {
-                DrawTextEx(font, spotify_data.artist, (Vector2) { 100, 100 }, 36, 0, WHITE);
-                DrawTextEx(font, spotify_data.title, (Vector2) { 100, 140 }, 72, 0, WHITE);
-            } else {
-                DrawText(spotify_data.artist, 100, 100, 32, WHITE);
-                DrawText(spotify_data.title, 100, 140, 64, WHITE);
+            // a single source is the whole window, no need to break the batch
+            bool panels = ctx->n_sources > 1;
+            if (panels) {
+                BeginScissorMode(0, panel_height * i, S_WIDTH, panel_height);
+                BeginMode2D((Camera2D) { .offset = { 0, panel_height * i }, .zoom = 1 });
+            }
+
+            if (ctx->opts.spectrogram) {
+                spectrogram_draw(&spectrograms[i], 0, 0, S_WIDTH, S_HEIGHT);
+                count_draw(4);
+            } else if (ctx->opts.two_channels)
+                render_two_channels(ctx, frame, &caches[i], &scratch, panel_bars);
+            else if (ctx->opts.all_channels)
+                render_all_channels(ctx, frame, &scratch, panel_bars);
+            else
+                render_mono_channel(ctx, frame, &caches[i], &scratch, panel_bars);
+
+            if (panels) {
+                EndMode2D();
+                EndScissorMode();
             }
         }
 
-        if (ctx->details == NULL)
-            continue;
+        S_HEIGHT = window_height;
 
-        if (ctx->opts.two_channels)
-            render_two_channels(ctx);
-        else
-            render_mono_channel(ctx);
+        metrics_since(&ctx->metrics, METRIC_RENDER, render_start);
+        metrics_count_frame(&ctx->metrics, DRAW_COUNTS.draws, DRAW_COUNTS.vertices);
 
-        struct timespec render_end;
-        clock_gettime(CLOCK_REALTIME, &render_end);
+        EndDrawing();
 
-        if (ctx->opts.log_timings) {
-            float diff_ms = timespec_diff_ns(&render_start, &render_end) / 1000000;
-            float last_diff_ms = timespec_diff_ns(&ctx->_last_render, &render_start) / 1000000;
-            fprintf(stderr, "render took %.2fms (%d/sec) (last was %.2fms ago)\n", diff_ms, (int) (1000 / diff_ms), last_diff_ms);
+        // after the buffer swap and the SetTargetFPS wait, that's what frame pacing changes
+        int64_t presented = metrics_now();
+        for (size_t i = 0; i < ctx->n_sources; i++) {
+            if (new_frames[i] && frames[i]->time.capture_ns != 0)
+                metrics_record_source(&ctx->metrics, i, METRIC_LATENCY, presented - frames[i]->time.capture_ns);
         }
+    }
 
-        ctx->_last_render = render_end;
 
-        EndDrawing();
+    mpris_stop(&mpris);
+    overlay_free(&overlay);
+
+    if (ctx->opts.spectrogram) {
+        for (size_t i = 0; i < ctx->n_sources; i++)
+            spectrogram_free(&spectrograms[i]);
     }
 
+    if (panel_bars != NULL)
+        bars_free(panel_bars);
+
+    arena_free(&scratch);
+    arena_free(&cache_arena);
+
     CloseWindow();
 
     pw_main_loop_quit(ctx->loop);
@@ -1,15 +1,14 @@
 #ifndef __PAV_UTIL
 #define __PAV_UTIL
 
-#include<time.h>
 #include<assert.h>
+#include<semaphore.h>
+#include<pthread.h>
 #include<pipewire/pipewire.h>
 #include<spa/param/audio/format-utils.h>
 
-#define MIN(a, b) ((a) < (b) ? (a) : (b))
-#define MAX(a, b) ((a) < (b) ? (b) : (a))
-
-#define NANOS_PER_SEC 1000000000
+#include "dsp.h"
+#include "pav_export.h"
 
 static float timespec_diff_ns(struct timespec *start, struct timespec *end) {
     time_t sec_diff = end->tv_sec - start->tv_sec;
@@ -17,15 +16,59 @@ static float timespec_diff_ns(struct timespec *start, struct timespec *end) {
     return sec_diff * NANOS_PER_SEC + (end->tv_nsec - start->tv_nsec);
 }
 
+// dsp.h can't see SPA, so its limit is kept in sync here
+_Static_assert(MAX_CHANNELS <= SPA_AUDIO_MAX_CHANNELS, "MAX_CHANNELS exceeds what SPA can describe");
+
+// most --pw-source nodes captured at once
+#define MAX_SOURCES 8
+
+// --ring-size bounds, the smallest fits twice PipeWire's largest quantum (8192 frames) of 8 f32 channels
+#define RING_MIN_KIB 512
+#define RING_MAX_KIB (1 << 20)
+
+// --renderer, how the bars and waveforms get to the screen, see bars.c
+typedef enum {
+    RENDERER_IMMEDIATE,
+    RENDERER_SHADER,
+} renderer_t;
+
 typedef struct opts_s {
     int monitor;
     float sample_boost;
     int width;
     int height;
-    int pw_source;
+    // --pw-source, once per node, none connects to whatever PipeWire picks
+    int pw_sources[MAX_SOURCES];
+    int n_pw_sources;
+    int ring_kib;
+    int fft_size;
+    int hop;
+    float agc_target;
+    float agc_attack_ms;
+    float agc_release_ms;
+    int band_scale;
+    int n_bands;
+    int idle_fps;
+    float silence_db;
+    int workers;
 
     char *font;
 
+    // offline mode, see offline.c
+    char *input;
+    int quantum;
+    int input_rate;
+    int input_channels;
+
+    // capture files, see capture.c
+    char *record;
+    char *replay;
+    bool replay_realtime;
+
+    // stats file rewritten by the metrics reporter
+    char *metrics;
+    int metrics_interval_ms;
+
     bool unlimited_fps;
     bool log_timings;
     bool flip_colors;
@@ -33,29 +76,171 @@ typedef struct opts_s {
 
     bool mirror;
     bool two_channels;
+    bool all_channels;
+
+    // waterfall of the last history frames, see spectrogram.c
+    bool spectrogram;
+    int history;
+
+    renderer_t renderer;
+
+    // gradient stops replacing color_progression/_alt, see palette.c
+    char *palette;
+    char *palette_alt;
+
+    // shared memory the frames are published in instead of a window, see export.c
+    char *export_shm;
 } opts_t;
 
+// a colour progression quantised to a table, see palette.c
+#define PALETTE_SIZE 256
+
 typedef struct {
-    float *samples;
-    float *fft;
-} channel_details_t;
+    Color colors[PALETTE_SIZE];
+} palette_t;
+
+
+// pipeline stages timed by metrics_record, see metrics.c
+typedef enum {
+    METRIC_PROCESS,
+    METRIC_CYCLE,
+    METRIC_QUEUE,
+    METRIC_SPLIT,
+    METRIC_AGC,
+    METRIC_FFT,
+    METRIC_ANALYSIS,
+    METRIC_RENDER,
+    METRIC_FRAME,
+    METRIC_LATENCY,
+    METRIC_COUNT,
+} metric_stage_t;
+
+// 8 buckets per power of two of nanoseconds
+#define METRICS_BUCKETS 512
+
+// the renderer's own stages, then one set per source, they run at their own rates and quanta
+#define METRICS_TABLES (1 + MAX_SOURCES)
 
 typedef struct {
-    struct pw_main_loop *loop;
-    struct pw_stream *stream;
+    _Atomic uint64_t count;
+    _Atomic uint64_t total_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint32_t buckets[METRICS_BUCKETS];
+} stage_metrics_t;
+
+typedef struct {
+    // [0] is render and frame, [1 + i] everything source i's stream and analysis record
+    stage_metrics_t stages[METRICS_TABLES][METRIC_COUNT];
 
+    // raylib draws and vertices the renderer submitted, summed over the frames it drew, see ui.c
+    _Atomic uint64_t frames;
+    _Atomic uint64_t draws;
+    _Atomic uint64_t vertices;
+
+    // reporter thread, only running with --log-timings or --metrics
+    sem_t wakeup;
+    atomic_bool quit;
+    pthread_t tid;
+    bool running;
+} metrics_t;
+
+// on_process -> file, see capture.c
+typedef struct {
+    int fd;
+    bool failed;
+    uint32_t sequence;
+
+    spsc_ring_t ring;
+    sem_t wakeup;
+    atomic_bool quit;
+    pthread_t tid;
+} recorder_t;
+
+// --export-shm, see export.c
+typedef struct {
+    char name[256];
+    uint8_t *map;
+    size_t map_size;
+    pav_export_header_t *header;
+} exporter_t;
+
+// one captured node, its stream and everything the analysis keeps for it up to the published frames
+typedef struct {
+    struct ctx_s *ctx;
+    size_t index;
+    uint32_t node;
+
+    struct pw_stream *stream;
+    struct spa_hook listener;
     struct spa_audio_info format;
+    // the negotiated format as the analysis sees it, false until one of ours was picked
+    bool format_ok;
+    sample_format_t sample_format;
+    bool planar;
 
-    size_t n_total_samples;
-    size_t n_samples;
     size_t n_channels;
     size_t relevant_fft_bins;
-    channel_details_t *details;
+
+    stft_t stft;
+    agc_t agc[MAX_CHANNELS];
+    band_map_t bands;
+    frame_buffer_t frames;
+
+    // silence detection, see analysis_idle
+    size_t silent_windows;
+
+    // on_process -> analysis thread
+    spsc_ring_t ring;
+
+    // analysis thread -> spectrogram, a uint32_t band count and that many bytes per published frame,
+    //  only set up with --spectrogram
+    spsc_ring_t rows;
+    uint8_t *row;
+    float row_peak;
+
+    // CLOCK_MONOTONIC ns, for METRIC_CYCLE
+    int64_t _last_audio_buffer;
+} source_t;
+
+typedef struct ctx_s {
+    struct pw_main_loop *loop;
+    struct pw_context *context;
+    struct pw_core *core;
+
+    // one per --pw-source, offline and replay only use the first
+    source_t sources[MAX_SOURCES];
+    size_t n_sources;
+
+    // dBFS --silence-db as a mean square
+    float silence_level;
+
+    // --workers, fans the per channel stages out, see analysis_run
+    pool_t pool;
+
+    // analysis -> renderer, posted for every published frame
+    sem_t render_wakeup;
+    // main -> renderer, set once the PipeWire loop is done, the renderer closes the window and exits
+    atomic_bool render_quit;
+
+    // any on_process -> analysis thread, it drains every source's ring
+    sem_t analysis_wakeup;
+    atomic_bool analysis_quit;
+
+    // only set up with --record, takes the first source
+    recorder_t recorder;
+
+    metrics_t metrics;
 
     opts_t opts;
 
-    struct timespec _last_render;
-    struct timespec _last_audio_buffer;
+    // only mapped with --export-shm
+    exporter_t exporter;
+
+    // the main colours and the second channel's, --flip-colors is already applied
+    palette_t palettes[2];
+
+    // CLOCK_MONOTONIC ns, for METRIC_FRAME
+    int64_t _last_render;
 } ctx_t;
 
 Color color_progression(float progress) {